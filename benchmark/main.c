@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Measures the time it takes to mix a number of looping SFX with different
+// frequencies, for several numbers of active channels and buffer sizes. Then,
+// it compares SFX played at exactly 1.0, 0.5 and 2.0 times the output sample
+// rate with SFX played at a slightly different rate. Then, it compares SFX
+// with 8-bit and 16-bit samples. The results are printed in nanoseconds per
+// frame. Finally, it measures the time it takes to fill the small buffers used
+// by low-latency audio devices while a song is played, in microseconds per
+// buffer.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <umod/umod.h>
+
+#include "file.h"
+
+#include "pack_header.h"
+
+// Sample rate of the WAV file, so that a multiplier of 1.0 plays it at exactly
+// the output sample rate.
+#define SAMPLE_RATE         44100
+
+#define MAX_VOICES          (UMOD_SFX_CHANNELS + UMOD_SONG_CHANNELS)
+
+// Total number of frames mixed for each combination of voices and buffer size
+#define FRAMES_PER_RUN      (256 * 1024)
+#define RUNS                5
+
+#define MIN_BUFFER_SIZE     16
+#define MAX_BUFFER_SIZE     4096
+
+// Buffer size used to compare frequency multipliers
+#define RATE_BUFFER_SIZE    1024
+
+// Buffer sizes of low-latency audio devices. Some of them aren't multiples of 4
+// so that the mixer has to handle a few frames at the end of the buffers.
+static const int callback_sizes[] = { 32, 33, 64, 65, 96, 127, 128 };
+
+static int8_t left[MAX_BUFFER_SIZE], right[MAX_BUFFER_SIZE];
+
+static uint64_t time_ns(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Multipliers are 16.16. If 'spread' is 0, all channels use 'multiplier'.
+static int start_voices(int voices, uint32_t multiplier, uint32_t spread)
+{
+    UMOD_SFX_StopAll();
+
+    for (int i = 0; i < voices; i++)
+    {
+        umod_handle handle = UMOD_SFX_Play(SFX_HELICOPTER_WAV, UMOD_LOOP_ENABLE);
+        if (handle == UMOD_HANDLE_INVALID)
+            return -1;
+
+        if (UMOD_SFX_SetFrequencyMultiplier(handle, multiplier + i * spread) != 0)
+            return -1;
+
+        if (UMOD_SFX_SetPanning(handle, (i * 255) / MAX_VOICES) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// Returns the time it takes to mix one frame in nanoseconds. The best of a few
+// runs is used to reduce the noise caused by other processes.
+static double measure(int size)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int run = 0; run < RUNS; run++)
+    {
+        uint64_t start = time_ns();
+
+        for (int frames = 0; frames < FRAMES_PER_RUN; frames += size)
+            UMOD_Mix(&left[0], &right[0], size);
+
+        uint64_t end = time_ns();
+
+        if ((end - start) < best)
+            best = end - start;
+    }
+
+    return (double)best / FRAMES_PER_RUN;
+}
+
+// Returns the time it takes to fill one buffer in microseconds. The song is
+// restarted if it ends, so that there are song ticks in the middle of most
+// buffers.
+static double measure_callback(int size)
+{
+    uint64_t best = UINT64_MAX;
+    int callbacks = FRAMES_PER_RUN / size;
+
+    for (int run = 0; run < RUNS; run++)
+    {
+        uint64_t start = time_ns();
+
+        for (int i = 0; i < callbacks; i++)
+        {
+            if (!UMOD_Song_IsPlaying())
+                UMOD_Song_Play(SONG_RANGE_TEST_MOD);
+
+            UMOD_Mix(&left[0], &right[0], size);
+        }
+
+        uint64_t end = time_ns();
+
+        if ((end - start) < best)
+            best = end - start;
+    }
+
+    return (double)best / callbacks / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pack_path = BENCHMARK_PACK_PATH;
+    const char *pack_16_bit_path = BENCHMARK_PACK_16_BIT_PATH;
+
+    if (argc > 3)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    if (argc >= 2)
+        pack_path = argv[1];
+    if (argc == 3)
+        pack_16_bit_path = argv[2];
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    void *pack_16_bit_buffer = NULL;
+    size_t pack_16_bit_size;
+
+    int rc = -1;
+
+    file_load(pack_path, &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    file_load(pack_16_bit_path, &pack_16_bit_buffer, &pack_16_bit_size);
+    if (pack_16_bit_size == 0)
+        goto cleanup;
+
+    UMOD_Init(SAMPLE_RATE);
+
+    if (UMOD_LoadPack(pack_buffer) != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    // Lend all song channels to the SFX player
+    if (UMOD_Song_YieldChannels(UMOD_SONG_CHANNELS) != 0)
+    {
+        printf("UMOD_Song_YieldChannels() failed\n");
+        goto cleanup;
+    }
+
+    printf("Mixer: %s (ns per frame)\n\n", BENCHMARK_MIXER_NAME);
+
+    printf("voices");
+    for (int size = MIN_BUFFER_SIZE; size <= MAX_BUFFER_SIZE; size *= 4)
+        printf(" %7d", size);
+    printf("\n");
+
+    for (int voices = 1; voices <= MAX_VOICES; voices++)
+    {
+        printf("%6d", voices);
+
+        for (int size = MIN_BUFFER_SIZE; size <= MAX_BUFFER_SIZE; size *= 4)
+        {
+            // Spread the frequencies between 0.5x and 1.875x so that the
+            // channels don't read the same samples in the same order.
+            if (start_voices(voices, 1 << 15, (1 << 16) / 8) != 0)
+            {
+                printf("\nFailed to start %d voices\n", voices);
+                goto cleanup;
+            }
+
+            printf(" %7.2f", measure(size));
+        }
+
+        printf("\n");
+    }
+
+    // The slightly different multipliers don't result in a whole number of
+    // samples per frame, so they use the generic mixing code.
+
+    const struct {
+        const char *name;
+        uint32_t multiplier;
+    } rates[] = {
+        { "1.0", 1 << 16 }, { "~1.0", (1 << 16) + 256 },
+        { "0.5", 1 << 15 }, { "~0.5", (1 << 15) + 256 },
+        { "2.0", 2 << 16 }, { "~2.0", (2 << 16) + 256 },
+    };
+
+    const int num_rates = sizeof(rates) / sizeof(rates[0]);
+
+    printf("\nBuffer size: %d\n\n", RATE_BUFFER_SIZE);
+
+    printf("voices");
+    for (int r = 0; r < num_rates; r++)
+        printf(" %7s", rates[r].name);
+    printf("\n");
+
+    for (int voices = 1; voices <= MAX_VOICES; voices++)
+    {
+        printf("%6d", voices);
+
+        for (int r = 0; r < num_rates; r++)
+        {
+            if (start_voices(voices, rates[r].multiplier, 0) != 0)
+            {
+                printf("\nFailed to start %d voices\n", voices);
+                goto cleanup;
+            }
+
+            printf(" %7.2f", measure(RATE_BUFFER_SIZE));
+        }
+
+        printf("\n");
+    }
+
+    // Both packs have the same SFX with the same indices. Each voice reads
+    // about SAMPLE_RATE samples per second, so 16-bit samples need twice the
+    // memory bandwidth of 8-bit samples. The multiplier isn't exactly 1.0 so
+    // that 8-bit samples use the generic mixing code, like 16-bit samples.
+
+    printf("\nSample format (buffer size: %d)\n\n", RATE_BUFFER_SIZE);
+
+    printf("Pack size: %zu bytes (8-bit), %zu bytes (16-bit)\n",
+           pack_size, pack_16_bit_size);
+    printf("Sample data read per voice: %d bytes/s (8-bit), %d bytes/s (16-bit)\n\n",
+           SAMPLE_RATE, SAMPLE_RATE * 2);
+
+    printf("voices   8-bit  16-bit\n");
+
+    for (int voices = 1; voices <= MAX_VOICES; voices++)
+    {
+        printf("%6d", voices);
+
+        void *packs[] = { pack_buffer, pack_16_bit_buffer };
+
+        for (int p = 0; p < 2; p++)
+        {
+            UMOD_SFX_StopAll();
+
+            if (UMOD_LoadPack(packs[p]) != 0)
+            {
+                printf("\nUMOD_LoadPack() failed\n");
+                goto cleanup;
+            }
+
+            if (start_voices(voices, (1 << 16) + 256, 0) != 0)
+            {
+                printf("\nFailed to start %d voices\n", voices);
+                goto cleanup;
+            }
+
+            printf(" %7.2f", measure(RATE_BUFFER_SIZE));
+        }
+
+        printf("\n");
+    }
+
+    // Low-latency callbacks. The song uses all of its channels, and the SFX
+    // channels are used for additional voices.
+
+    printf("\nSong and SFX, small buffers (us per buffer)\n\n");
+
+    UMOD_SFX_StopAll();
+
+    if (UMOD_LoadPack(pack_buffer) != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    if (UMOD_Song_YieldChannels(0) != 0)
+    {
+        printf("UMOD_Song_YieldChannels() failed\n");
+        goto cleanup;
+    }
+
+    const int num_sizes = sizeof(callback_sizes) / sizeof(callback_sizes[0]);
+
+    printf("   sfx");
+    for (int i = 0; i < num_sizes; i++)
+        printf(" %7d", callback_sizes[i]);
+    printf("\n");
+
+    for (int voices = 0; voices <= UMOD_SFX_CHANNELS; voices++)
+    {
+        printf("%6d", voices);
+
+        for (int i = 0; i < num_sizes; i++)
+        {
+            if (start_voices(voices, 1 << 15, (1 << 16) / 8) != 0)
+            {
+                printf("\nFailed to start %d voices\n", voices);
+                goto cleanup;
+            }
+
+            if (UMOD_Song_Play(SONG_RANGE_TEST_MOD) != 0)
+            {
+                printf("\nUMOD_Song_Play() failed\n");
+                goto cleanup;
+            }
+
+            printf(" %7.3f", measure_callback(callback_sizes[i]));
+        }
+
+        printf("\n");
+    }
+
+    UMOD_Song_Stop();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    free(pack_16_bit_buffer);
+
+    return rc;
+}
@@ -0,0 +1,395 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <umod/umod.h>
+#include <umod/umodpack.h>
+#include <umod/umodrecorder.h>
+
+#include "compile.h"
+#include "file.h"
+
+// The sample rate doesn't affect the recorded commands, but it needs to be high
+// enough to have at least one sample per tick with the highest tempo.
+#define RECORDER_SAMPLE_RATE    (32 * 1024)
+
+// Songs that don't end or loop after this number of ticks aren't compiled. This
+// is one hour at the default tempo.
+#define RECORDER_MAX_TICKS      (50 * 60 * 60)
+
+typedef struct {
+    int         pattern;
+    int         row;
+    size_t      offset;     // Offset of the commands of the row in the stream
+    uint8_t    *state;      // State of the player at the start of the row
+
+    // Last period sent to each channel. Porta commands are saved relative to
+    // it, so the stream can only jump to this row if they are the same.
+    uint32_t    period[UMOD_SONG_CHANNELS];
+} recorded_row;
+
+static struct {
+    const uint8_t  *pack;
+
+    int             recording;
+    int             finished;   // Set to 1 when a loop is found
+    int             error;
+
+    uint8_t        *stream;
+    size_t          size;
+    size_t          capacity;
+
+    int             ticks;
+    int             pending_ticks; // Ticks that have ended but aren't saved
+    uint32_t        period[UMOD_SONG_CHANNELS];
+
+    recorded_row   *rows;
+    size_t          num_rows;
+    size_t          rows_capacity;
+} rec;
+
+static void stream_write(uint32_t value, int bytes)
+{
+    if (rec.size + bytes > rec.capacity)
+    {
+        size_t capacity = rec.capacity == 0 ? 4096 : rec.capacity * 2;
+        uint8_t *stream = realloc(rec.stream, capacity);
+        if (stream == NULL)
+        {
+            rec.error = 1;
+            return;
+        }
+
+        rec.stream = stream;
+        rec.capacity = capacity;
+    }
+
+    for (int i = 0; i < bytes; i++)
+        rec.stream[rec.size++] = (value >> (i * 8)) & 0xFF;
+}
+
+static void stream_write_command(int command, int channel)
+{
+    stream_write((command << 4) | channel, 1);
+}
+
+// Saves the end of all ticks that have ended. Consecutive ticks with no
+// commands are merged.
+static void flush_pending_ticks(void)
+{
+    while (rec.pending_ticks > 0)
+    {
+        int ticks = rec.pending_ticks > 16 ? 16 : rec.pending_ticks;
+
+        stream_write_command(COMMAND_END_TICK, ticks - 1);
+
+        rec.pending_ticks -= ticks;
+    }
+}
+
+static int instrument_get_index(uintptr_t pointer)
+{
+    const umodpack_header *header = (const umodpack_header *)rec.pack;
+
+    const uint32_t *offsets = (const uint32_t *)(rec.pack + sizeof(*header));
+    offsets += header->num_songs + header->num_patterns;
+
+    for (uint32_t i = 0; i < header->num_instruments; i++)
+    {
+        if ((uintptr_t)(rec.pack + offsets[i]) == pointer)
+            return i;
+    }
+
+    return -1;
+}
+
+void UMOD_Recorder_TickStart(void)
+{
+    if ((rec.recording == 0) || rec.finished)
+        return;
+
+    if (rec.ticks > 0)
+        rec.pending_ticks++;
+
+    rec.ticks++;
+
+    if (rec.ticks > RECORDER_MAX_TICKS)
+    {
+        printf("Song too long\n");
+        rec.error = 1;
+    }
+}
+
+void UMOD_Recorder_RowStart(int pattern, int row)
+{
+    if ((rec.recording == 0) || rec.finished)
+        return;
+
+    // Don't merge the first tick of a row with the previous ticks so that it
+    // can be the destination of a jump.
+    flush_pending_ticks();
+
+    size_t state_size = UMOD_Recorder_GetState(NULL, 0);
+    uint8_t *state = malloc(state_size);
+    if (state == NULL)
+    {
+        rec.error = 1;
+        return;
+    }
+
+    UMOD_Recorder_GetState(state, state_size);
+
+    // If this row has been reached before with the same state, the song loops
+    // from this point.
+    for (size_t i = 0; i < rec.num_rows; i++)
+    {
+        recorded_row *r = &rec.rows[i];
+
+        if ((r->pattern != pattern) || (r->row != row))
+            continue;
+
+        if (memcmp(r->state, state, state_size) != 0)
+            continue;
+
+        if (memcmp(r->period, rec.period, sizeof(rec.period)) != 0)
+            continue;
+
+        stream_write_command(COMMAND_JUMP, 0);
+        stream_write(r->offset, 4);
+
+        rec.finished = 1;
+        free(state);
+        return;
+    }
+
+    if (rec.num_rows == rec.rows_capacity)
+    {
+        size_t capacity = rec.rows_capacity == 0 ? 256 : rec.rows_capacity * 2;
+        recorded_row *rows = realloc(rec.rows, capacity * sizeof(recorded_row));
+        if (rows == NULL)
+        {
+            rec.error = 1;
+            free(state);
+            return;
+        }
+
+        rec.rows = rows;
+        rec.rows_capacity = capacity;
+    }
+
+    recorded_row *r = &rec.rows[rec.num_rows++];
+
+    *r = (recorded_row){
+        .pattern = pattern,
+        .row = row,
+        .offset = rec.size,
+        .state = state
+    };
+
+    memcpy(r->period, rec.period, sizeof(rec.period));
+}
+
+void UMOD_Recorder_Command(int channel, int command, uint64_t value)
+{
+    if ((rec.recording == 0) || rec.finished)
+        return;
+
+    flush_pending_ticks();
+
+    switch (command)
+    {
+        case COMMAND_NOTE_PERIOD:
+        case COMMAND_PORTA_PERIOD:
+        {
+            if (value > UINT32_MAX)
+            {
+                printf("Period out of range: %llu\n", (unsigned long long)value);
+                rec.error = 1;
+                return;
+            }
+
+            int64_t delta = (int64_t)value - rec.period[channel];
+            rec.period[channel] = value;
+
+            if ((command == COMMAND_PORTA_PERIOD) &&
+                (delta >= INT16_MIN) && (delta <= INT16_MAX))
+            {
+                stream_write_command(COMMAND_PORTA_DELTA, channel);
+                stream_write((uint16_t)delta, 2);
+            }
+            else
+            {
+                stream_write_command(command, channel);
+                stream_write(value, 4);
+            }
+            break;
+        }
+        case COMMAND_VOLUME:
+        case COMMAND_PANNING:
+        case COMMAND_TEMPO:
+            if (value > UINT8_MAX)
+            {
+                printf("Value out of range: %llu\n", (unsigned long long)value);
+                rec.error = 1;
+                return;
+            }
+
+            stream_write_command(command, channel);
+            stream_write(value, 1);
+            break;
+
+        case COMMAND_INSTRUMENT:
+        {
+            int index = instrument_get_index(value);
+            if (index < 0)
+            {
+                printf("Unknown instrument\n");
+                rec.error = 1;
+                return;
+            }
+
+            stream_write_command(command, channel);
+            stream_write(index, 2);
+            break;
+        }
+        case COMMAND_SAMPLE_OFFSET:
+            stream_write_command(command, channel);
+            stream_write(value, 4);
+            break;
+
+        case COMMAND_STOP:
+            stream_write_command(command, channel);
+            break;
+
+        default:
+            printf("Unknown command: %d\n", command);
+            rec.error = 1;
+            break;
+    }
+}
+
+static void recorder_reset(void)
+{
+    for (size_t i = 0; i < rec.num_rows; i++)
+        free(rec.rows[i].state);
+
+    free(rec.rows);
+    free(rec.stream);
+
+    const uint8_t *pack = rec.pack;
+
+    memset(&rec, 0, sizeof(rec));
+
+    rec.pack = pack;
+}
+
+// Runs the song player and saves all the commands it sends to the mixer. It
+// returns 0 on success.
+static int compile_song(uint32_t index)
+{
+    recorder_reset();
+
+    if (UMOD_Song_Play(index) != 0)
+        return -1;
+
+    rec.recording = 1;
+
+    int8_t buffer[256];
+
+    while (UMOD_Song_IsPlaying() && (rec.finished == 0) && (rec.error == 0))
+        UMOD_Mix(buffer, buffer, sizeof(buffer));
+
+    // The song has reached the end instead of looping
+    if (rec.finished == 0)
+        stream_write_command(COMMAND_SONG_END, 0);
+
+    rec.recording = 0;
+
+    UMOD_Song_Stop();
+
+    if (rec.error)
+        return -1;
+
+    return 0;
+}
+
+int compile_songs(const char *path)
+{
+    void *pack;
+    size_t size;
+
+    file_load(path, &pack, &size);
+    if (pack == NULL)
+        return -1;
+
+    int ret = -1;
+
+    FILE *f = fopen(path, "rb+");
+    if (f == NULL)
+        goto cleanup;
+
+    UMOD_Init(RECORDER_SAMPLE_RATE);
+
+    if (UMOD_LoadPack(pack) != 0)
+    {
+        printf("Invalid pack file\n");
+        goto cleanup;
+    }
+
+    rec.pack = pack;
+
+    const umodpack_header *header = pack;
+    const uint32_t *song_offsets =
+                (const uint32_t *)((uintptr_t)pack + sizeof(*header));
+
+    for (uint32_t i = 0; i < header->num_songs; i++)
+    {
+        if (compile_song(i) != 0)
+        {
+            printf("Song %u couldn't be compiled\n", i);
+            goto cleanup;
+        }
+
+        // Append the stream to the pack file, aligned to 32 bit
+
+        fseek(f, 0, SEEK_END);
+
+        long align = (4 - (ftell(f) & 3)) & 3;
+        uint8_t val = 0;
+        while (align > 0)
+        {
+            fwrite(&val, sizeof(val), 1, f);
+            align--;
+        }
+
+        uint32_t compiled_offset = ftell(f);
+
+        if (fwrite(rec.stream, rec.size, 1, f) != 1)
+            goto cleanup;
+
+        // Point the song to the stream
+
+        fseek(f, song_offsets[i] + offsetof(umodpack_song, compiled_offset),
+              SEEK_SET);
+        fwrite(&compiled_offset, sizeof(compiled_offset), 1, f);
+
+        printf("Compiled song %u: %u ticks, %zu bytes\n", i, rec.ticks,
+               rec.size);
+    }
+
+    ret = 0;
+
+cleanup:
+    recorder_reset();
+    if (f != NULL)
+        fclose(f);
+    free(pack);
+
+    return ret;
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#ifndef COMPILE_H__
+#define COMPILE_H__
+
+// Adds a compiled version of all songs to a pack file that has already been
+// saved. It returns 0 on success.
+int compile_songs(const char *path);
+
+#endif // COMPILE_H__
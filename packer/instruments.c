@@ -9,11 +9,14 @@
 
 typedef struct {
     int8_t     *data;
-    size_t      size;
+    size_t      size;       // Number of frames
+    int         bits_per_sample; // 8 or 16
+    int         channels;   // 1 (mono) or 2 (stereo, interleaved)
     int         volume;
     int         finetune;
     size_t      loop_start;
     size_t      loop_length;
+    int         loop_type;  // INSTRUMENT_LOOP_xxx
     uint32_t    frequency;  // Default playback frequency (for WAV files)
 } generic_instrument;
 
@@ -60,9 +63,13 @@ static int new_instrument(void)
     return instruments_used++;
 }
 
-int instrument_add(int8_t *data, size_t size, int volume, int finetune,
-                   size_t loop_start, size_t loop_length, uint32_t frequency)
+int instrument_add(const void *data, size_t size, int bits_per_sample,
+                   int channels, int volume, int finetune,
+                   size_t loop_start, size_t loop_length, int loop_type,
+                   uint32_t frequency)
 {
+    size_t data_size = size * (bits_per_sample / 8) * channels;
+
     // Fix instrument
 
     if (size == 0)
@@ -90,27 +97,20 @@ int instrument_add(int8_t *data, size_t size, int volume, int finetune,
     {
         generic_instrument *instrument = instruments[index];
 
-        if ((instrument->size != size) || (instrument->volume != volume) ||
+        if ((instrument->size != size) ||
+            (instrument->bits_per_sample != bits_per_sample) ||
+            (instrument->channels != channels) ||
+            (instrument->volume != volume) ||
             (instrument->finetune != finetune) ||
             (instrument->loop_start != loop_start) ||
             (instrument->loop_length != loop_length) ||
+            (instrument->loop_type != loop_type) ||
             (instrument->frequency != frequency))
         {
             continue;
         }
 
-        int different = 0;
-
-        for (size_t i = 0; i < size; i++)
-        {
-            if (instrument->data[i] != data[i])
-            {
-                different = 1;
-                break;
-            }
-        }
-
-        if (different)
+        if (memcmp(instrument->data, data, data_size) != 0)
             continue;
 
         // Everything matches, don't allocate a new instrument, return index of
@@ -131,19 +131,21 @@ int instrument_add(int8_t *data, size_t size, int volume, int finetune,
 
     generic_instrument *instrument = instruments[instrument_index];
     instrument->size = size;
+    instrument->bits_per_sample = bits_per_sample;
+    instrument->channels = channels;
 
     instrument->volume = volume;
     instrument->finetune = finetune;
     instrument->loop_start = loop_start;
     instrument->loop_length = loop_length;
+    instrument->loop_type = loop_type;
     instrument->frequency = frequency;
 
-    instrument->data = malloc(size);
+    instrument->data = malloc(data_size);
     if (instrument->data == NULL)
         return -1;
 
-    for (size_t i = 0; i < size; i++)
-        instrument->data[i] = data[i];
+    memcpy(instrument->data, data, data_size);
 
     return instrument_index;
 }
@@ -154,8 +156,8 @@ int instrument_total_number(void)
 }
 
 int instrument_get(int instrument_index, int8_t **data, size_t *size,
-                   int *volume, int *finetune,
-                   size_t *loop_start, size_t *loop_length,
+                   int *bits_per_sample, int *channels, int *volume, int *finetune,
+                   size_t *loop_start, size_t *loop_length, int *loop_type,
                    uint32_t *frequency)
 {
     if (instrument_index >= instruments_used)
@@ -164,10 +166,13 @@ int instrument_get(int instrument_index, int8_t **data, size_t *size,
     generic_instrument *instrument = instruments[instrument_index];
 
     *size = instrument->size;
+    *bits_per_sample = instrument->bits_per_sample;
+    *channels = instrument->channels;
     *volume = instrument->volume;
     *finetune = instrument->finetune;
     *loop_start = instrument->loop_start;
     *loop_length = instrument->loop_length;
+    *loop_type = instrument->loop_type;
     *data = instrument->data;
     *frequency = instrument->frequency;
 
@@ -8,15 +8,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
-// volume = 0-255
-int instrument_add(int8_t *data, size_t size, int volume, int finetune,
-                   size_t loop_start, size_t loop_length, uint32_t frequency);
+// size = Number of frames, bits_per_sample = 8 or 16, channels = 1 or 2,
+// volume = 0-255, loop_type = INSTRUMENT_LOOP_xxx. Stereo data is interleaved,
+// with the left sample first.
+int instrument_add(const void *data, size_t size, int bits_per_sample,
+                   int channels, int volume, int finetune,
+                   size_t loop_start, size_t loop_length, int loop_type,
+                   uint32_t frequency);
 
 int instrument_total_number(void);
 
 int instrument_get(int instrument_index, int8_t **data, size_t *size,
-                   int *volume, int *finetune,
-                   size_t *loop_start, size_t *loop_length,
+                   int *bits_per_sample, int *channels, int *volume, int *finetune,
+                   size_t *loop_start, size_t *loop_length, int *loop_type,
                    uint32_t *frequency);
 
 int instrument_get_volume(int instrument_index, int *volume);
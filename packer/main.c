@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "compile.h"
 #include "mod.h"
 #include "save_header.h"
 #include "save_pack.h"
@@ -62,17 +63,48 @@ int add_file(const char *path)
 
 int main(int argc, char *argv[])
 {
+    int compile = 0;
+
+    while ((argc > 1) && (strncmp(argv[1], "--", 2) == 0))
+    {
+        if (strcmp(argv[1], "--compile-songs") == 0)
+        {
+            compile = 1;
+        }
+        else if (strcmp(argv[1], "--16-bit") == 0)
+        {
+            wav_set_16_bit(1);
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[1]);
+            return -1;
+        }
+
+        argc--; // Skip option
+        argv++;
+    }
+
     if (argc < 4)
     {
         printf("Not enough arguments.\n\n");
 
-        printf("Usage: %s [output pack].bin [output header].h <audio files>\n\n",
-               argv[0]);
+        printf("Usage: %s [--compile-songs] [--16-bit] [output pack].bin "
+               "[output header].h <audio files>\n\n", argv[0]);
+
+        printf("Options:\n"
+               "\n"
+               "  --compile-songs: Pre-calculate the effects of all songs so\n"
+               "                   that the player doesn't need to do it.\n"
+               "  --16-bit:        Keep the samples of 16-bit WAV files as\n"
+               "                   16-bit. They use twice as much memory. By\n"
+               "                   default they are converted to 8 bit.\n"
+               "\n");
 
         printf("Supported formats:\n"
                "\n"
                "  MOD: 4 and 8 channels\n"
-               "  WAV: PCM (no ADPCM)\n"
+               "  WAV: PCM (no ADPCM), mono or stereo\n"
                "\n");
 
         return -1;
@@ -102,5 +134,12 @@ int main(int argc, char *argv[])
 
     header_end();
 
-    return save_pack(save_file);
+    int ret = save_pack(save_file);
+    if (ret != 0)
+        return ret;
+
+    if (compile)
+        return compile_songs(save_file);
+
+    return 0;
 }
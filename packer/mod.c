@@ -252,11 +252,11 @@ int add_mod(const char *path, int *song_index)
 
             // Note: The samples of a MOD file are already 8-bit signed
             instrument_index[i] = instrument_add(instrument_pointer,
-                                                 instrument_size,
+                                                 instrument_size, 8, 1,
                                                  volume, instrument->fine_tune,
                                                  instrument_loop_point,
                                                  instrument_loop_length,
-                                                 0);
+                                                 INSTRUMENT_LOOP_FORWARD, 0);
         }
 
         printf("\n");
@@ -21,7 +21,10 @@ int save_pack(const char *path)
     if (f == NULL)
         return -1;
 
-    fprintf(f, "UMOD");
+    fprintf(f, UMODPACK_MAGIC);
+
+    uint32_t version = UMODPACK_VERSION;
+    fwrite(&version, sizeof(version), 1, f);
 
     uint32_t num_songs = song_total_number();
     fwrite(&num_songs, sizeof(num_songs), 1, f);
@@ -72,6 +75,10 @@ int save_pack(const char *path)
         size_t length;
         song_get(i, &data, &length);
 
+        // Songs are compiled after the pack has been saved
+        uint32_t compiled_offset = 0;
+        fwrite(&compiled_offset, sizeof(compiled_offset), 1, f);
+
         uint16_t length_ = length;
         fwrite(&length_, sizeof(length_), 1, f);
 
@@ -180,11 +187,14 @@ int save_pack(const char *path)
 
         int8_t *data;
         size_t size, loop_start, loop_length;
-        int volume, finetune;
+        int bits_per_sample, channels, volume, finetune, loop_type;
         uint32_t frequency;
 
-        instrument_get(i, &data, &size, &volume, &finetune,
-                       &loop_start, &loop_length, &frequency);
+        instrument_get(i, &data, &size, &bits_per_sample, &channels,
+                       &volume, &finetune, &loop_start, &loop_length,
+                       &loop_type, &frequency);
+
+        size_t bytes_per_frame = (bits_per_sample / 8) * channels;
 
         int looping = 0;
         if (loop_length > 0)
@@ -226,70 +236,25 @@ int save_pack(const char *path)
         value = finetune;
         fwrite(&value, sizeof(value), 1, f);
 
-        for (size_t j = 0; j < size; j++)
-        {
-            int8_t sample = data[j];
-            fwrite(&sample, sizeof(sample), 1, f);
-        }
-
-        // Write some more samples to help with mixer optimizations
-
-        if (looping)
-        {
-            // Repeat loop
-
-            if (loop_at_the_end)
-            {
-                // The only thing needed is to add the buffer
-
-                size_t j = loop_start;
-
-                for (int s = 0; s < UMODPACK_INSTRUMENT_EXTRA_SAMPLES; s++)
-                {
-                    int8_t sample = data[j];
-                    fwrite(&sample, sizeof(sample), 1, f);
-
-                    j++;
-
-                    if (j == (loop_start + loop_length))
-                        j = loop_start;
-                }
-            }
-            else
-            {
-                // First, copy the loop again
-
-                for (size_t j = loop_start; j <= (loop_start + loop_length); j++)
-                {
-                    int8_t sample = data[j];
-                    fwrite(&sample, sizeof(sample), 1, f);
-                }
-
-                // Then, add the buffer
+        value = 0;
+        if (bits_per_sample == 16)
+            value |= INSTRUMENT_16_BIT;
+        if (channels == 2)
+            value |= INSTRUMENT_STEREO;
+        fwrite(&value, sizeof(value), 1, f);
 
-                size_t j = loop_start;
+        value = loop_type;
+        fwrite(&value, sizeof(value), 1, f);
 
-                for (int s = 0; s < UMODPACK_INSTRUMENT_EXTRA_SAMPLES; s++)
-                {
-                    int8_t sample = data[j];
-                    fwrite(&sample, sizeof(sample), 1, f);
+        fwrite(data, bytes_per_frame, size, f);
 
-                    j++;
+        // If the loop isn't at the end, copy it after the waveform. The mixer
+        // never reads past the end of the loop, so nothing else is needed.
 
-                    if (j == (loop_start + loop_length))
-                        j = loop_start;
-                }
-            }
-        }
-        else
+        if ((looping == 1) && (loop_at_the_end == 0))
         {
-            // Write zeroes as buffer
-
-            for (int s = 0; s < UMODPACK_INSTRUMENT_EXTRA_SAMPLES; s++)
-            {
-                int8_t sample = 0;
-                fwrite(&sample, sizeof(sample), 1, f);
-            }
+            fwrite(&data[loop_start * bytes_per_frame], bytes_per_frame,
+                   loop_length, f);
         }
 
         // Align next element to 32 bit
@@ -87,6 +87,13 @@ typedef struct {
 
 #pragma pack(pop)
 
+static int wav_16_bit = 0;
+
+void wav_set_16_bit(int enable)
+{
+    wav_16_bit = enable;
+}
+
 int add_wav(const char *path, int *instrument_index)
 {
     assert(path != NULL);
@@ -140,11 +147,13 @@ int add_wav(const char *path, int *instrument_index)
     int data_read = 0;
 
     uint32_t sample_rate = 0;
+    uint16_t num_channels = 0;
     uint16_t bits_per_sample = 0;
     uint32_t data_size = 0;
     void *wav_data = NULL;
     uint32_t wav_loop_start = 0;
     uint32_t wav_loop_length = 0;
+    int wav_loop_type = INSTRUMENT_LOOP_FORWARD;
 
     while (1)
     {
@@ -182,14 +191,18 @@ int add_wav(const char *path, int *instrument_index)
                 goto cleanup;
             }
 
-            if (fmt->num_channels != 1)
+            if ((fmt->num_channels != 1) && (fmt->num_channels != 2))
             {
-                printf("  Only wav files with one channel are supported: num channels: %"
+                printf("  Only wav files with one or two channels are supported: num channels: %"
                        PRIx16 "\n",
                        fmt->num_channels);
                 goto cleanup;
             }
 
+            num_channels = fmt->num_channels;
+
+            printf("    Channels: %" PRIu16 "\n", num_channels);
+
             sample_rate = fmt->sample_rate;
 
             printf("    Sample rate: %" PRIu32 "\n", sample_rate);
@@ -249,11 +262,21 @@ int add_wav(const char *path, int *instrument_index)
                 goto cleanup;
             }
 
-            if (smpl->sample_loop[0].type != 0)
+            switch (smpl->sample_loop[0].type)
             {
-                printf("  Only forward loops are supported. Value: %" PRIu32 "\n",
-                       smpl->sample_loop[0].type);
-                goto cleanup;
+                case 0:
+                    wav_loop_type = INSTRUMENT_LOOP_FORWARD;
+                    break;
+                case 1:
+                    wav_loop_type = INSTRUMENT_LOOP_PINGPONG;
+                    break;
+                case 2:
+                    wav_loop_type = INSTRUMENT_LOOP_BACKWARD;
+                    break;
+                default:
+                    printf("  Unsupported loop type. Value: %" PRIu32 "\n",
+                           smpl->sample_loop[0].type);
+                    goto cleanup;
             }
 
             if (smpl->sample_loop[0].play_count != 0)
@@ -266,7 +289,8 @@ int add_wav(const char *path, int *instrument_index)
             uint32_t start = smpl->sample_loop[0].start;
             uint32_t end = smpl->sample_loop[0].end;
 
-            printf("    Loop: %" PRIu32 " - %" PRIu32 "\n", start, end);
+            printf("    Loop: %" PRIu32 " - %" PRIu32 " (type %" PRIu32 ")\n",
+                   start, end, smpl->sample_loop[0].type);
 
             if (end > data_size)
             {
@@ -315,31 +339,42 @@ int add_wav(const char *path, int *instrument_index)
             waveform[i] = waveform[i] - 128;
 
         printf("  ");
-        *instrument_index = instrument_add((int8_t *)waveform, waveform_samples,
+        *instrument_index = instrument_add(waveform,
+                                           waveform_samples / num_channels,
+                                           8, num_channels,
                                            255, 0, // volume, finetune
                                            wav_loop_start, wav_loop_length,
-                                           sample_rate);
+                                           wav_loop_type, sample_rate);
         printf("\n");
     }
     else if (bits_per_sample == 16)
     {
         // Samples are stored as signed integers: -32768 - 32767
 
-        uint16_t *waveform = wav_data;
+        int16_t *waveform = wav_data;
         size_t waveform_samples = data_size / 2;
 
-        // The samples of the pack file are 8-bit signed (-128 - 127)
+        int bits = 16;
 
-        int8_t *waveform_dst = (int8_t *)waveform;
+        if (wav_16_bit == 0)
+        {
+            // The samples of the pack file are 8-bit signed (-128 - 127)
 
-        for (size_t i = 0; i < waveform_samples; i++)
-            waveform_dst[i] = waveform[i] >> 8;
+            int8_t *waveform_dst = (int8_t *)waveform;
+
+            for (size_t i = 0; i < waveform_samples; i++)
+                waveform_dst[i] = waveform[i] >> 8;
+
+            bits = 8;
+        }
 
         printf("  ");
-        *instrument_index = instrument_add(waveform_dst, waveform_samples,
+        *instrument_index = instrument_add(waveform,
+                                           waveform_samples / num_channels,
+                                           bits, num_channels,
                                            255, 0, // volume, finetune
                                            wav_loop_start, wav_loop_length,
-                                           sample_rate);
+                                           wav_loop_type, sample_rate);
         printf("\n");
     }
     else
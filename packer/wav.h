@@ -7,4 +7,8 @@
 
 int add_wav(const char *path, int *instrument_index);
 
+// If enabled, 16-bit WAV files are saved as 16-bit instruments. If not, they
+// are converted to 8 bit. It is disabled by default.
+void wav_set_16_bit(int enable);
+
 #endif // WAV_H__
@@ -11,23 +11,70 @@
 // Global functions
 // ================
 
-// Initialize player and set up the desired sample rate.
+typedef enum {
+    // UMOD_Mix() fills the left and right buffers.
+    UMOD_OUTPUT_STEREO = 0,
+
+    // UMOD_Mix() only fills the left buffer with the average of both sides.
+    // The right buffer is ignored, and it can be NULL. This is faster than
+    // mixing in stereo, and it is meant for devices with only one speaker.
+    UMOD_OUTPUT_MONO = 1
+} umod_output_mode;
+
+// Initialize player and set up the desired sample rate. The output is stereo.
 void UMOD_Init(uint32_t sample_rate);
 
+// Like UMOD_Init(), but with the specified output mode.
+void UMOD_InitOutput(uint32_t sample_rate, umod_output_mode mode);
+
 // Load a pack file to be used from this point. When switching between pack
-// files, make sure that there are no songs or SFXs being played. It returns 0
-// on success.
+// files, make sure that there are no songs or SFXs being played. Pack files
+// generated by a different version of the packer are rejected. It returns 0 on
+// success.
 int UMOD_LoadPack(const void *pack);
 
 // Fills the specified buffers with audio data to be sent to the output device.
+// In mono mode right_buffer isn't used.
 void UMOD_Mix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size);
 
+// Like UMOD_Mix(), but the output buffers are ring buffers of 'capacity' frames
+// each. The frames are written starting at 'write_index' (it is used modulo
+// 'capacity'), and they wrap around to the start of the buffers when they reach
+// the end. 'frames' can't be bigger than 'capacity'. In mono mode right_base
+// isn't used. It returns 0 on success.
+int UMOD_MixRing(int8_t *left_base, int8_t *right_base, size_t capacity,
+                 size_t write_index, size_t frames);
+
+// Updates the song and the SFX as if UMOD_Mix() had been called with a buffer
+// of the specified size, but without generating any audio. This is much faster
+// than mixing, and the state of the player afterwards is exactly the same. It
+// can be used to seek forward in a song.
+void UMOD_Skip(size_t buffer_size);
+
+// Bus API
+// =======
+
+// All channels are mixed into one of the following buses. Song channels always
+// use UMOD_BUS_MUSIC. SFX use the bus of their group, which is UMOD_BUS_SFX
+// unless it is changed with UMOD_SFX_GroupSetBus().
+#define UMOD_BUS_MUSIC          0
+#define UMOD_BUS_SFX            1
+#define UMOD_BUS_VOICE          2
+#define UMOD_BUS_UI             3
+
+#define UMOD_BUSES              (4)
+
+// Set volume of a bus. Values: 0 - 256 (it is clamped if it's outside of this
+// range). It returns 0 on success.
+int UMOD_Bus_SetVolume(int bus, int volume);
+
 // Song API
 // ========
 
 #define UMOD_SONG_CHANNELS      (8)
 
-// Set master volume for all the song channels. Values: 0 - 256.
+// Set master volume for all the song channels. Values: 0 - 256. This is the
+// same as setting the volume of UMOD_BUS_MUSIC.
 void UMOD_Song_SetMasterVolume(int volume);
 
 // Plays the specified song (MOD_xxx defines, etc). It stops the currently
@@ -51,6 +98,14 @@ int UMOD_Song_Resume(void);
 // Stops the song currently being played.
 void UMOD_Song_Stop(void);
 
+// Lends the last song channels to the SFX player. For example, if the value is
+// 2, channels 6 and 7 can be used to play SFX. The song keeps being updated, but
+// the notes of the yielded channels aren't heard. Yielded channels are taken
+// back by calling this function with a smaller value (0 takes all of them
+// back). Any SFX being played in a channel that is taken back is stopped.
+// Values: 0 - UMOD_SONG_CHANNELS. It returns 0 on success.
+int UMOD_Song_YieldChannels(int channels);
+
 // SFX API
 // =======
 
@@ -75,8 +130,22 @@ typedef enum {
     UMOD_LOOP_DISABLE = 2
 } umod_loop_type;
 
+// Priorities of SFX. Values: 0 - 255 (higher values are more important).
+#define UMOD_SFX_PRIORITY_LOWEST    0
+#define UMOD_SFX_PRIORITY_DEFAULT   128
+#define UMOD_SFX_PRIORITY_HIGHEST   255
+
+// Every SFX belongs to a group. The volume, panning and frequency of a group are
+// applied to all of its SFX, on top of the values of each SFX. For example, a
+// game can use one group for footsteps, another one for the user interface and
+// another one for ambience sounds, and change their settings independently.
+#define UMOD_SFX_GROUPS             (8)
+
+#define UMOD_SFX_GROUP_DEFAULT      0
+
 // Set master volume for all the SFX channels. Values: 0 - 256 (it is clamped if
-// it's outside of this range).
+// it's outside of this range). This is the same as setting the volume of
+// UMOD_BUS_SFX, so it doesn't affect SFX groups assigned to other buses.
 void UMOD_SFX_SetMasterVolume(int volume);
 
 // Play SFX that corresponds to the specified SFX_xxx define. It returns a
@@ -89,8 +158,26 @@ void UMOD_SFX_SetMasterVolume(int volume);
 //
 // This function returns UMOD_HANDLE_INVALID if the SFX doesn't exist, or if
 // there are no available channels.
+//
+// The SFX is played with priority UMOD_SFX_PRIORITY_DEFAULT.
 umod_handle UMOD_SFX_Play(uint32_t index, umod_loop_type loop_type);
 
+// Like UMOD_SFX_Play(), but with the specified priority (it is clamped if it's
+// outside of the valid range).
+//
+// If all channels are being used, the SFX player looks for a channel to stop.
+// Released channels are always stopped first. If there aren't any, a channel
+// with a lower priority than the new SFX is stopped. Between channels with the
+// same priority, the ones that are about to end, that have a low volume, or
+// that have been playing for a long time are stopped first.
+umod_handle UMOD_SFX_PlayPriority(uint32_t index, umod_loop_type loop_type,
+                                  int priority);
+
+// Like UMOD_SFX_PlayPriority(), but the SFX is added to the specified group
+// instead of UMOD_SFX_GROUP_DEFAULT. Values: 0 - (UMOD_SFX_GROUPS - 1).
+umod_handle UMOD_SFX_PlayGroup(uint32_t index, umod_loop_type loop_type,
+                               int priority, int group);
+
 // Set volume for the specified effect. Values: 0 - 255 (it is clamped if it's
 // outside this range). Returns 0 on success. It can fail if the handle is
 // invalid or if the SFX has already finished.
@@ -99,12 +186,30 @@ int UMOD_SFX_SetVolume(umod_handle handle, int volume);
 // Set panning for the specified effect. Values: 0 (left) - 255 (right). Returns
 // 0 on success. It can fail if the handle is invalid or if the SFX has already
 // finished.
+//
+// In stereo SFX the panning works as a balance control: the left side of the
+// SFX is only played in the left side of the output, and the right side in the
+// right side. The panning sets the volume of each side, like in mono SFX.
 int UMOD_SFX_SetPanning(umod_handle handle, int panning);
 
 // Set new playback frequency of the SFX. Multiplier in fixed point format
 // 16.16. It returns 0 on success.
 int UMOD_SFX_SetFrequencyMultiplier(umod_handle handle, uint32_t multiplier);
 
+typedef struct {
+    umod_handle handle;
+    int         volume;                 // 0 - 255, or -1 to leave it unchanged
+    int         panning;                // 0 - 255, or -1 to leave it unchanged
+    uint32_t    frequency_multiplier;   // 16.16, or 0 to leave it unchanged
+} umod_sfx_update;
+
+// Updates the volume, panning and frequency of several effects at once. This is
+// faster than calling UMOD_SFX_SetVolume(), UMOD_SFX_SetPanning() and
+// UMOD_SFX_SetFrequencyMultiplier() for each effect. Updates with handles that
+// aren't valid anymore are skipped. It returns 0 if all the updates have been
+// applied, -1 if any of them has been skipped.
+int UMOD_SFX_Update(const umod_sfx_update *updates, size_t count);
+
 // Release the channel playing this SFX. When a channel is released, it means it
 // is available for another SFX. If a new SFX is requested and no other channels
 // are free, the SFXs in the released channels will be used. It returns 0 on
@@ -121,4 +226,96 @@ int UMOD_SFX_Stop(umod_handle handle);
 // Stop playing all active sound effects.
 void UMOD_SFX_StopAll(void);
 
+// Move an effect to a different group. It returns 0 on success.
+int UMOD_SFX_SetGroup(umod_handle handle, int group);
+
+// Set volume of a group. Values: 0 - 256 (it is clamped if it's outside of this
+// range). It returns 0 on success.
+int UMOD_SFX_GroupSetVolume(int group, int volume);
+
+// Set panning of a group. It is added to the panning of each effect in the
+// group. Values: 0 (left) - 128 (no change) - 255 (right). It returns 0 on
+// success.
+int UMOD_SFX_GroupSetPanning(int group, int panning);
+
+// Set the bus that the SFX of a group are mixed into. It returns 0 on success.
+int UMOD_SFX_GroupSetBus(int group, int bus);
+
+// Set frequency multiplier of a group in fixed point format 16.16. It is
+// multiplied by the multiplier of each effect in the group. It returns 0 on
+// success.
+int UMOD_SFX_GroupSetFrequencyMultiplier(int group, uint32_t multiplier);
+
+// Stem API
+// ========
+
+// There is one stem per channel. Song channels go first, followed by the SFX
+// channels. If song channels have been yielded, their stems contain the SFX
+// played in them.
+#define UMOD_STEMS  (UMOD_SONG_CHANNELS + UMOD_SFX_CHANNELS)
+
+// Like UMOD_Mix(), but it also writes the output of each channel to its own
+// buffers. Each stem is what UMOD_Mix() would generate if that channel was the
+// only one being played, so it is clamped on its own, and the sum of all the
+// stems may be slightly different from the master mix. The master mix is the
+// same as the one generated by UMOD_Mix().
+//
+// Stems with a NULL entry in stems_left aren't generated. In stereo mode all
+// the other stems need a buffer in stems_right. In mono mode stems_right isn't
+// used, and it can be NULL. The stems are written while the master mix is
+// generated, so every channel is still only mixed once.
+//
+// The library needs to be built with UMOD_STEM_MIXING defined, or this function
+// will fail. It returns 0 on success.
+int UMOD_MixStems(int8_t *left_buffer, int8_t *right_buffer,
+                  int8_t *const stems_left[UMOD_STEMS],
+                  int8_t *const stems_right[UMOD_STEMS], size_t buffer_size);
+
+// Metering API
+// ============
+
+// Levels are in 1.15 fixed point: 32768 is the full scale of the output
+// buffers. Channel levels are the contribution of each channel to the mix
+// before it is clamped, so they use the same scale as the master levels.
+typedef struct {
+    uint16_t    peak_left;
+    uint16_t    peak_right;
+    uint16_t    rms_left;
+    uint16_t    rms_right;
+} umod_meter;
+
+typedef struct {
+    // Song channels go first, followed by the SFX channels.
+    umod_meter  channel[UMOD_SONG_CHANNELS + UMOD_SFX_CHANNELS];
+    umod_meter  master;
+    uint32_t    frames; // Number of frames the levels have been measured over
+} umod_meters;
+
+// Get the levels measured during the last call to UMOD_Mix(). The library needs
+// to be built with UMOD_METERING defined, or this function will fail. It
+// returns 0 on success.
+int UMOD_GetMeters(umod_meters *meters);
+
+// Profiling API
+// =============
+
+// Statistics of the last call to UMOD_Mix(). Times are measured in CPU cycles on
+// GBA and in nanoseconds in any other platform.
+typedef struct {
+    uint32_t    tick_time;      // Time spent updating the song every tick
+    uint32_t    decode_time;    // Part of tick_time spent decoding patterns
+    uint32_t    mix_time;       // Time spent mixing channels
+    uint16_t    ticks;          // Number of song ticks processed
+    uint16_t    active_voices;  // Maximum number of channels mixed at once
+    uint16_t    voice_steals;   // SFX channels taken from another SFX
+                                // (released or lower priority)
+    uint16_t    loop_wraps;     // Number of times a sample has looped
+    uint16_t    period_divides; // Number of note periods converted to steps
+} umod_profile;
+
+// Get the statistics of the last call to UMOD_Mix(). The library needs to be
+// built with UMOD_PROFILING defined, or this function will fail. It returns 0
+// on success.
+int UMOD_GetProfile(umod_profile *profile);
+
 #endif // UMOD_UMOD_H__
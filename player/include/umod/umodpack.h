@@ -7,8 +7,16 @@
 
 #include <stdint.h>
 
+// The version is increased every time the format of pack files changes. Pack
+// files with a different version are rejected by UMOD_LoadPack(). Packs from
+// before the version field existed start with "UMOD" instead.
+
+#define UMODPACK_MAGIC      "UMPK"
+#define UMODPACK_VERSION    1
+
 typedef struct {
-    char        magic[4]; // "UMOD"
+    char        magic[4]; // UMODPACK_MAGIC
+    uint32_t    version;  // UMODPACK_VERSION
     uint32_t    num_songs;
     uint32_t    num_patterns;
     uint32_t    num_instruments;
@@ -18,6 +26,7 @@ typedef struct {
 } umodpack_header;
 
 typedef struct {
+    uint32_t    compiled_offset; // Offset to the compiled song (0 if none)
     uint16_t    num_of_patterns;
     uint16_t    pattern_index[];
 } umodpack_song;
@@ -29,16 +38,33 @@ typedef struct {
 } umodpack_pattern;
 
 typedef struct {
-    uint32_t    size;
-    uint32_t    loop_start;
-    uint32_t    loop_end;
+    uint32_t    size;       // Size and loop points are in frames. A frame has
+    uint32_t    loop_start; // one sample in mono instruments, and two samples
+    uint32_t    loop_end;   // (left and right) in stereo instruments.
     uint32_t    frequency;  // Default playback frequency.
     uint8_t     volume;
     uint8_t     finetune;
-    int8_t      data[];     // Waveform data. Samples are 8 bit signed integers.
+    uint8_t     flags;      // INSTRUMENT_xxx flags
+    uint8_t     loop_type;  // INSTRUMENT_LOOP_xxx
+    int8_t      data[];     // Waveform data. Samples are 8 bit signed integers,
+                            // or 16 bit if INSTRUMENT_16_BIT is set. Stereo
+                            // frames store the left sample first.
 } umodpack_instrument;
 
-#define UMODPACK_INSTRUMENT_EXTRA_SAMPLES   64
+// Instrument flags
+
+#define INSTRUMENT_16_BIT       (1 << 0)
+#define INSTRUMENT_STEREO       (1 << 1)
+
+// Instrument loop types. The waveform is played forwards until the end, which
+// is treated as the end of the loop. After that, forward loops jump to the start
+// of the loop, ping-pong loops change direction every time they reach the start
+// or the end of the loop, and backward loops are played backwards from the end
+// to the start of the loop.
+
+#define INSTRUMENT_LOOP_FORWARD     0
+#define INSTRUMENT_LOOP_PINGPONG    1
+#define INSTRUMENT_LOOP_BACKWARD    2
 
 // Pattern step flags
 
@@ -78,4 +104,28 @@ typedef struct {
 #define EFFECT_TREMOLO              21
 #define EFFECT_TREMOLO_WAVEFORM     22
 
+// Compiled songs
+//
+// A compiled song is the list of commands that the song player sends to the
+// mixer channels in each tick. It is generated by the packer by running the
+// song player, so the player doesn't need to decode patterns or update effects.
+//
+// Each command is one byte, with the command type in the top 4 bits and the
+// channel (or a count) in the low 4 bits. The arguments follow the command in
+// little endian format with no alignment. Periods are stored in 20.12 format
+// in units of Amiga periods (Amiga Period [Octave 0] >> octave).
+
+#define COMMAND_END_TICK        0   // Low bits: Number of empty ticks after it
+#define COMMAND_NOTE_PERIOD     1   // Period (4 bytes). Restarts the sample
+#define COMMAND_PORTA_PERIOD    2   // Period (4 bytes)
+#define COMMAND_PORTA_DELTA     3   // Period - previous period (2 bytes)
+#define COMMAND_VOLUME          4   // Volume (1 byte)
+#define COMMAND_PANNING         5   // Panning (1 byte)
+#define COMMAND_INSTRUMENT      6   // Instrument index (2 bytes)
+#define COMMAND_SAMPLE_OFFSET   7   // Offset in samples (4 bytes)
+#define COMMAND_STOP            8
+#define COMMAND_TEMPO           9   // BPM (1 byte). The channel is ignored
+#define COMMAND_JUMP            10  // Offset from the start of the song (4 bytes)
+#define COMMAND_SONG_END        11
+
 #endif // UMOD_UMODPACK_H__
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#ifndef UMOD_UMODRECORDER_H__
+#define UMOD_UMODRECORDER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recorder interface
+// ==================
+//
+// When the player is built with UMOD_RECORDER defined, the mixer doesn't
+// generate any audio. Instead, all the commands that the song player sends to
+// the mixer are passed to the functions below, which need to be implemented by
+// the program that uses the player. This is used by the packer to generate
+// compiled songs (see umodpack.h).
+//
+// In this mode, all periods are Amiga periods in 20.12 format, which don't
+// depend on the sample rate.
+
+// Called at the start of every tick of the song, before any command.
+void UMOD_Recorder_TickStart(void);
+
+// Called in the first tick of every row, before any command of that tick.
+void UMOD_Recorder_RowStart(int pattern, int row);
+
+// Called for every command sent to a song channel (COMMAND_xxx defines). The
+// value of COMMAND_INSTRUMENT is a pointer to the instrument.
+void UMOD_Recorder_Command(int channel, int command, uint64_t value);
+
+// Copies the state of the song player to the provided buffer. If the state of
+// the player is the same at the start of the same row twice, the song will
+// loop from that point. The state is a list of int64_t values, one for each
+// field of the player that affects the commands sent in the future, so two
+// states can be compared with memcmp(). It returns the size of the state in
+// bytes. Only the values that fit in the buffer are copied.
+size_t UMOD_Recorder_GetState(void *buffer, size_t size);
+
+#endif // UMOD_UMODRECORDER_H__
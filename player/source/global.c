@@ -5,30 +5,46 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <umod/umod.h>
 #include <umod/umodpack.h>
 
 #include "definitions.h"
 #include "global.h"
+#include "mixer_channel.h"
 #include "mod_channel.h"
+#include "profile.h"
+#include "sound_effect.h"
 
 static umod_loaded_pack loaded_pack;
 
 static uint32_t global_sample_rate;
 
 void UMOD_Init(uint32_t sample_rate)
+{
+    UMOD_InitOutput(sample_rate, UMOD_OUTPUT_STEREO);
+}
+
+void UMOD_InitOutput(uint32_t sample_rate, umod_output_mode mode)
 {
     global_sample_rate = sample_rate;
 
+    MixerSetMono(mode == UMOD_OUTPUT_MONO);
+
+    ProfileInit();
+
     ModSetSampleRateConvertConstant(sample_rate);
 
-    // This will load all the pointers to the mixer channels so that the song
-    // volume can be changed.
+    // Give all the SFX channels to the SFX player, and return the song channels
+    // that may have been yielded to the song.
+    SFX_Init();
+    UMOD_Song_YieldChannels(0);
+
     ModChannelResetAll();
-    UMOD_Song_SetMasterVolume(256);
 
-    UMOD_SFX_SetMasterVolume(256);
+    for (int i = 0; i < UMOD_BUSES; i++)
+        UMOD_Bus_SetVolume(i, 256);
 }
 
 uint32_t GetGlobalSampleRate(void)
@@ -43,11 +59,12 @@ int UMOD_LoadPack(const void *pack)
 
     const umodpack_header *header = pack;
 
-    if ((header->magic[0] != 'U') || (header->magic[1] != 'M') ||
-        (header->magic[2] != 'O') || (header->magic[3] != 'D'))
-    {
+    if (memcmp(header->magic, UMODPACK_MAGIC, sizeof(header->magic)) != 0)
         return -2;
-    }
+
+    // Packs generated by a different version of the packer can't be read
+    if (header->version != UMODPACK_VERSION)
+        return -5;
 
     loaded_pack.data = pack;
 
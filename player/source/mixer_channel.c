@@ -4,18 +4,55 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <umod/umod.h>
 #include <umod/umodpack.h>
 
 #include "definitions.h"
 #include "mixer_channel.h"
+#include "profile.h"
+
+#ifdef UMOD_RECORDER
+# include <umod/umodrecorder.h>
+#endif
 
 static mixer_channel_info mixer_channel[MIXER_CHANNELS_MAX];
 
+static_assert(MIXER_CHANNELS_MAX <= 32, "Too many channels for the ended mask");
+
+static uint32_t mixer_channels_ended;
+
+// List of channels that aren't stopped, in no particular order. It is updated
+// whenever a channel starts or stops, so that the mixer doesn't need to check
+// all channels every time it is called.
+static mixer_channel_info *mixer_playing_ch[MIXER_CHANNELS_MAX];
+static int mixer_playing_channels;
+
+static uint64_t mixer_frame_counter;
+
+static mixer_bus_info mixer_bus[MIXER_BUSES];
+
+// If this is set, only the left buffer is used
+static int mixer_mono;
+
 // Direct access functions
 // =======================
 
+#ifdef UMOD_RECORDER
+// Only the commands sent to the song channels are recorded
+static void MixerRecord(mixer_channel_info *ch, int command, uint64_t value)
+{
+    if (ch->owner != MIXER_OWNER_SONG)
+        return;
+
+    UMOD_Recorder_Command(ch - &mixer_channel[0], command, value);
+}
+# define RECORD(ch, command, value) MixerRecord(ch, command, value)
+#else
+# define RECORD(ch, command, value)
+#endif
+
 mixer_channel_info *MixerChannelGetFromIndex(uint32_t index)
 {
     if (index >= MIXER_CHANNELS_MAX)
@@ -30,9 +67,85 @@ void MixerChannelRefreshVolumes(mixer_channel_info *ch)
 {
     assert(ch != NULL);
 
-    int channel_volume = ch->master_volume * ch->volume;
-    ch->left_volume = (channel_volume * ch->left_panning) >> 8;
-    ch->right_volume = (channel_volume * ch->right_panning) >> 8;
+    ch->left_volume = ch->volume * ch->left_panning;
+    ch->right_volume = ch->volume * ch->right_panning;
+    ch->mono_volume = (ch->left_volume + ch->right_volume) >> 1;
+
+    // 16-bit samples are scaled down after applying the volume, so they can't
+    // be mixed into the center accumulator without changing the rounding.
+    // Stereo samples have different values in each side, so they are always
+    // mixed in both sides.
+
+    if (ch->sample.format & MIXER_FORMAT_STEREO)
+        ch->pan_class = MIXER_PAN_STEREO;
+    else if (ch->left_volume == 0)
+        ch->pan_class = MIXER_PAN_RIGHT;
+    else if (ch->right_volume == 0)
+        ch->pan_class = MIXER_PAN_LEFT;
+    else if ((ch->left_panning == MIXER_PAN_CENTER_LEFT) &&
+             (ch->right_panning == MIXER_PAN_CENTER_RIGHT) &&
+             (ch->sample.format == MIXER_FORMAT_8_BIT))
+        ch->pan_class = MIXER_PAN_CENTER;
+    else
+        ch->pan_class = MIXER_PAN_STEREO;
+}
+
+// Sets the play state of a channel and adds it to or removes it from the list of
+// playing channels if needed.
+ARM_CODE IWRAM_CODE
+static inline void MixerChannelSetState(mixer_channel_info *ch, int state)
+{
+    if (ch->detached)
+    {
+        // Not in the list
+    }
+    else if ((ch->play_state == STATE_STOP) && (state != STATE_STOP))
+    {
+        ch->playing_index = mixer_playing_channels;
+        mixer_playing_ch[mixer_playing_channels++] = ch;
+    }
+    else if ((ch->play_state != STATE_STOP) && (state == STATE_STOP))
+    {
+        // Move the last channel of the list to the slot of this one
+        mixer_channel_info *last = mixer_playing_ch[--mixer_playing_channels];
+
+        mixer_playing_ch[ch->playing_index] = last;
+        last->playing_index = ch->playing_index;
+    }
+
+    ch->play_state = state;
+}
+
+void MixerChannelDetach(mixer_channel_info *copy, const mixer_channel_info *ch)
+{
+    assert((copy != NULL) && (ch != NULL));
+
+    *copy = *ch;
+    copy->detached = 1;
+
+#ifdef UMOD_STEM_MIXING
+    // The stems are set again by MixerMix() in every call
+    copy->stem_left = NULL;
+    copy->stem_right = NULL;
+#endif
+}
+
+void MixerChannelAttach(mixer_channel_info *ch, const mixer_channel_info *copy)
+{
+    assert((ch != NULL) && (copy != NULL));
+    assert(!ch->detached && copy->detached);
+
+    // Remove the channel from the list before its state is overwritten
+    MixerChannelSetState(ch, STATE_STOP);
+
+    *ch = *copy;
+    ch->detached = 0;
+    ch->play_state = STATE_STOP;
+}
+
+void MixerSetMono(int mono)
+{
+    mixer_mono = mono;
 }
 
 int MixerChannelIsPlaying(mixer_channel_info *ch)
@@ -49,9 +162,9 @@ int MixerChannelStart(mixer_channel_info *ch)
 {
     assert(ch != NULL);
 
-    ch->sample.position = 0; // 20.12
+    ch->sample.position = 0; // 52.12
 
-    ch->play_state = STATE_PLAY;
+    MixerChannelSetState(ch, STATE_PLAY);
 
     return 0;
 }
@@ -60,7 +173,9 @@ int MixerChannelStop(mixer_channel_info *ch)
 {
     assert(ch != NULL);
 
-    ch->play_state = STATE_STOP;
+    RECORD(ch, COMMAND_STOP, 0);
+
+    MixerChannelSetState(ch, STATE_STOP);
 
     return 1;
 }
@@ -69,34 +184,60 @@ int MixerChannelSetSampleOffset(mixer_channel_info *ch, uint32_t offset)
 {
     assert(ch != NULL);
 
+    RECORD(ch, COMMAND_SAMPLE_OFFSET, offset);
+
     if (offset >= (ch->sample.size >> 12))
     {
         // Fail if the position is out of bounds. Stop channel.
-        ch->play_state = STATE_STOP;
+        MixerChannelSetState(ch, STATE_STOP);
         return -1;
     }
 
-    ch->sample.position = offset << 12;
+    ch->sample.position = (uint64_t)offset << 12;
 
     return 0;
 }
 
+static int MixerGetKernel(uint32_t position_inc_per_sample, int format)
+{
+    if (format == (MIXER_FORMAT_16_BIT | MIXER_FORMAT_STEREO))
+        return MIXER_KERNEL_STEREO_16_BIT;
+    if (format == MIXER_FORMAT_STEREO)
+        return MIXER_KERNEL_STEREO;
+    if (format == MIXER_FORMAT_16_BIT)
+        return MIXER_KERNEL_16_BIT;
+
+    if (position_inc_per_sample == (1 << 12))
+        return MIXER_KERNEL_UNITY;
+    if (position_inc_per_sample == (1 << 11))
+        return MIXER_KERNEL_HALF;
+    if (position_inc_per_sample == (2 << 12))
+        return MIXER_KERNEL_DOUBLE;
+
+    return MIXER_KERNEL_GENERIC;
+}
+
 int MixerChannelSetNotePeriod(mixer_channel_info *ch, uint64_t period) // 32.32
 {
     assert(ch != NULL);
 
+    RECORD(ch, COMMAND_NOTE_PERIOD, period);
+
     if (period == 0) // TODO: Make sure this makes sense
     {
-        ch->play_state = STATE_STOP;
+        MixerChannelSetState(ch, STATE_STOP);
         return -1;
     }
 
-    ch->sample.position = 0; // 20.12
+    ch->sample.position = 0; // 52.12
 
     // 20.44 / 32.32 = 52.12 = 20.12
     ch->sample.position_inc_per_sample = ((uint64_t)1 << 44) / period;
+    ch->sample.kernel = MixerGetKernel(ch->sample.position_inc_per_sample,
+                                       ch->sample.format);
+    PROFILE_COUNT(period_divides);
 
-    ch->play_state = STATE_PLAY;
+    MixerChannelSetState(ch, STATE_PLAY);
 
     return 0;
 }
@@ -105,14 +246,19 @@ int MixerChannelSetNotePeriodPorta(mixer_channel_info *ch, uint64_t period) // 3
 {
     assert(ch != NULL);
 
+    RECORD(ch, COMMAND_PORTA_PERIOD, period);
+
     if (period == 0) // TODO: Make sure this makes sense
     {
-        ch->play_state = STATE_STOP;
+        MixerChannelSetState(ch, STATE_STOP);
         return -1;
     }
 
     // 20.44 / 32.32 = 52.12 = 20.12
     ch->sample.position_inc_per_sample = ((uint64_t)1 << 44) / period;
+    ch->sample.kernel = MixerGetKernel(ch->sample.position_inc_per_sample,
+                                       ch->sample.format);
+    PROFILE_COUNT(period_divides);
 
     return 0;
 }
@@ -121,6 +267,8 @@ int MixerChannelSetInstrument(mixer_channel_info *ch, umodpack_instrument *instr
 {
     assert(ch != NULL);
 
+    RECORD(ch, COMMAND_INSTRUMENT, (uintptr_t)instrument_pointer);
+
     if (instrument_pointer == NULL)
         return -1;
 
@@ -140,6 +288,38 @@ int MixerChannelSetInstrument(mixer_channel_info *ch, umodpack_instrument *instr
     ch->sample.loop_start = loop_start << 12;
     ch->sample.loop_end = loop_end << 12;
 
+    ch->sample.format = MIXER_FORMAT_8_BIT;
+    ch->sample.frame_shift = 0;
+
+    if (instrument->flags & INSTRUMENT_16_BIT)
+    {
+        ch->sample.format |= MIXER_FORMAT_16_BIT;
+        ch->sample.frame_shift++;
+    }
+    if (instrument->flags & INSTRUMENT_STEREO)
+    {
+        ch->sample.format |= MIXER_FORMAT_STEREO;
+        ch->sample.frame_shift++;
+    }
+
+    ch->sample.kernel = MixerGetKernel(ch->sample.position_inc_per_sample,
+                                       ch->sample.format);
+
+    switch (instrument->loop_type)
+    {
+        case INSTRUMENT_LOOP_PINGPONG:
+            ch->sample.loop_type = MIXER_LOOP_PINGPONG;
+            break;
+        case INSTRUMENT_LOOP_BACKWARD:
+            ch->sample.loop_type = MIXER_LOOP_BACKWARD;
+            break;
+        default:
+            ch->sample.loop_type = MIXER_LOOP_FORWARD;
+            break;
+    }
+
+    MixerChannelRefreshVolumes(ch);
+
     return 0;
 }
 
@@ -154,13 +334,13 @@ int MixerChannelSetLoop(mixer_channel_info *ch, umod_loop_type loop_type,
 
     if (loop_type == UMOD_LOOP_ENABLE)
     {
-        ch->play_state = STATE_LOOP;
-        ch->sample.loop_start = loop_start << 12;
-        ch->sample.loop_end = loop_end << 12;
+        MixerChannelSetState(ch, STATE_LOOP);
+        ch->sample.loop_start = (uint64_t)loop_start << 12;
+        ch->sample.loop_end = (uint64_t)loop_end << 12;
     }
     else
     {
-        ch->play_state = STATE_PLAY;
+        MixerChannelSetState(ch, STATE_PLAY);
         ch->sample.loop_start = 0;
         ch->sample.loop_end = 0;
     }
@@ -172,6 +352,8 @@ int MixerChannelSetVolume(mixer_channel_info *ch, int volume)
 {
     assert(ch != NULL);
 
+    RECORD(ch, COMMAND_VOLUME, volume);
+
     ch->volume = volume;
 
     MixerChannelRefreshVolumes(ch);
@@ -179,21 +361,25 @@ int MixerChannelSetVolume(mixer_channel_info *ch, int volume)
     return 0;
 }
 
-int MixerChannelSetMasterVolume(mixer_channel_info *ch, int volume)
+int MixerChannelSetPanning(mixer_channel_info *ch, int panning)
 {
     assert(ch != NULL);
 
-    ch->master_volume = volume;
+    RECORD(ch, COMMAND_PANNING, panning);
+
+    ch->left_panning = 255 - panning;
+    ch->right_panning = panning;
 
     MixerChannelRefreshVolumes(ch);
 
     return 0;
 }
 
-int MixerChannelSetPanning(mixer_channel_info *ch, int panning)
+int MixerChannelSetVolumePanning(mixer_channel_info *ch, int volume, int panning)
 {
     assert(ch != NULL);
 
+    ch->volume = volume;
     ch->left_panning = 255 - panning;
     ch->right_panning = panning;
 
@@ -202,273 +388,1625 @@ int MixerChannelSetPanning(mixer_channel_info *ch, int panning)
     return 0;
 }
 
-// Mixer function
-// ==============
+int MixerChannelSetOwner(mixer_channel_info *ch, int owner)
+{
+    assert(ch != NULL);
 
-#define UNROLLED_LOOP_ITERATIONS    16
+    ch->owner = owner;
 
-ARM_CODE IWRAM_CODE
-void MixerMix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size,
-              int mix_song)
-{
-    // Get list of all active channels
+    return 0;
+}
 
-    int active_channels = 0;
-    mixer_channel_info *active_ch[MIXER_CHANNELS_MAX];
+int MixerChannelSetBus(mixer_channel_info *ch, int bus)
+{
+    assert(ch != NULL);
+    assert((bus >= 0) && (bus < MIXER_BUSES));
 
-    int first_channel = mix_song ? 0 : UMOD_SONG_CHANNELS;
+    ch->bus = bus;
 
-    for (int channel = first_channel; channel < MIXER_CHANNELS_MAX; channel++)
-    {
-        mixer_channel_info *ch = &mixer_channel[channel];
+    return 0;
+}
 
-        if (ch->play_state == STATE_STOP)
-            continue;
+uint32_t MixerChannelsTakeEnded(void)
+{
+    uint32_t mask = mixer_channels_ended;
 
-        if (ch->sample.pointer == NULL)
-            continue;
+    mixer_channels_ended = 0;
 
-        // Make sure that the unrolled iterations won't go over the extra
-        // samples appended to the end of the instrument waveform.
-        assert(ch->sample.position_inc_per_sample <
-               (UMODPACK_INSTRUMENT_EXTRA_SAMPLES / UNROLLED_LOOP_ITERATIONS) << 12);
+    return mask;
+}
 
-        active_ch[active_channels++] = ch;
-    }
+uint64_t MixerGetFrameCounter(void)
+{
+    return mixer_frame_counter;
+}
 
-    // Mix active channels
+// Bus functions
+// =============
 
-    while (buffer_size >= UNROLLED_LOOP_ITERATIONS)
-    {
-        for (int c = 0; c < UNROLLED_LOOP_ITERATIONS / 4; c++)
-        {
-            int32_t total_left1 = 0;
-            int32_t total_right1 = 0;
-            int32_t total_left2 = 0;
-            int32_t total_right2 = 0;
-            int32_t total_left3 = 0;
-            int32_t total_right3 = 0;
-            int32_t total_left4 = 0;
-            int32_t total_right4 = 0;
-
-            for (int i = 0; i < active_channels; i++)
-            {
-                mixer_channel_info *ch = active_ch[i];
+int MixerBusSetVolume(int bus, int volume)
+{
+    if ((bus < 0) || (bus >= MIXER_BUSES))
+        return -1;
 
-                // -128..127
-                int32_t value = ch->sample.pointer[ch->sample.position >> 12];
-                ch->sample.position += ch->sample.position_inc_per_sample;
+    if (volume > 256)
+        volume = 256;
+    else if (volume < 0)
+        volume = 0;
 
-                total_left1 += value * ch->left_volume;
-                total_right1 += value * ch->right_volume;
+    mixer_bus[bus].volume = volume;
 
-                value = ch->sample.pointer[ch->sample.position >> 12];
-                ch->sample.position += ch->sample.position_inc_per_sample;
+    return 0;
+}
 
-                total_left2 += value * ch->left_volume;
-                total_right2 += value * ch->right_volume;
+int UMOD_Bus_SetVolume(int bus, int volume)
+{
+    return MixerBusSetVolume(bus, volume);
+}
 
-                value = ch->sample.pointer[ch->sample.position >> 12];
-                ch->sample.position += ch->sample.position_inc_per_sample;
+// Metering functions
+// ==================
 
-                total_left3 += value * ch->left_volume;
-                total_right3 += value * ch->right_volume;
+#ifdef UMOD_METERING
 
-                value = ch->sample.pointer[ch->sample.position >> 12];
-                ch->sample.position += ch->sample.position_inc_per_sample;
+static mixer_meter master_meter;
+static uint32_t master_meter_frames;
 
-                total_left4 += value * ch->left_volume;
-                total_right4 += value * ch->right_volume;
-            }
+static inline void MixerMeterUpdate(mixer_meter *meter, int32_t left, int32_t right)
+{
+    if (left < 0)
+        left = -left;
+    if (right < 0)
+        right = -right;
+
+    if (left > meter->peak_left)
+        meter->peak_left = left;
+    if (right > meter->peak_right)
+        meter->peak_right = right;
+
+    meter->sum_squares_left += (uint32_t)(left * left);
+    meter->sum_squares_right += (uint32_t)(right * right);
+}
 
-            // Total = sample * number of channels * volume * panning
-            //       -128...127         8            0...255  0...255
-            //
-            // The result needs to be scaled down and clamped to -128...127
-            //
-            // Divide by volume, panning first. Then, divide by a number smaller
-            // than the number of channels. 4 seems to be a good number to keep the
-            // volume up.
-
-            static_assert(MIXER_CHANNELS_MAX == (8 + 4),
-                          "Unexpected number of channels");
-            total_left1 >>= 2 + 8 + 8;  // 4 * max volume * max panning
-            total_right1 >>= 2 + 8 + 8; // 4 * max volume * max panning
-            total_left2 >>= 2 + 8 + 8;  // 4 * max volume * max panning
-            total_right2 >>= 2 + 8 + 8; // 4 * max volume * max panning
-            total_left3 >>= 2 + 8 + 8;  // 4 * max volume * max panning
-            total_right3 >>= 2 + 8 + 8; // 4 * max volume * max panning
-            total_left4 >>= 2 + 8 + 8;  // 4 * max volume * max panning
-            total_right4 >>= 2 + 8 + 8; // 4 * max volume * max panning
-
-            if (total_left1 < -128)
-                total_left1 = -128;
-            if (total_right1 < -128)
-                total_right1 = -128;
-            if (total_left1 > 127)
-                total_left1 = 127;
-            if (total_right1 > 127)
-                total_right1 = 127;
-
-            if (total_left2 < -128)
-                total_left2 = -128;
-            if (total_right2 < -128)
-                total_right2 = -128;
-            if (total_left2 > 127)
-                total_left2 = 127;
-            if (total_right2 > 127)
-                total_right2 = 127;
-
-            if (total_left3 < -128)
-                total_left3 = -128;
-            if (total_right3 < -128)
-                total_right3 = -128;
-            if (total_left3 > 127)
-                total_left3 = 127;
-            if (total_right3 > 127)
-                total_right3 = 127;
-
-            if (total_left4 < -128)
-                total_left4 = -128;
-            if (total_right4 < -128)
-                total_right4 = -128;
-            if (total_left4 > 127)
-                total_left4 = 127;
-            if (total_right4 > 127)
-                total_right4 = 127;
-
-            *left_buffer++ = total_left1;
-            *left_buffer++ = total_left2;
-            *left_buffer++ = total_left3;
-            *left_buffer++ = total_left4;
-
-            *right_buffer++ = total_right1;
-            *right_buffer++ = total_right2;
-            *right_buffer++ = total_right3;
-            *right_buffer++ = total_right4;
-        }
+// The contribution of a channel is scaled the same way as the final mix, but
+// keeping 8 more bits of precision so that it has the same scale as the master
+// meter. The volume of the bus is applied when the levels are read.
+# define METER_CHANNEL(ch, left, right) \
+    MixerMeterUpdate(&(ch)->meter, (left) >> (2 + 8), (right) >> (2 + 8))
+# define METER_MASTER(left, right) \
+    MixerMeterUpdate(&master_meter, (left) << 8, (right) << 8)
+# define METER_FRAMES(frames) \
+    master_meter_frames += (frames)
 
-        buffer_size -= UNROLLED_LOOP_ITERATIONS;
+#else
 
-        for (int i = 0; i < active_channels; i++)
-        {
-            mixer_channel_info *ch = active_ch[i];
+# define METER_CHANNEL(ch, left, right)
+# define METER_MASTER(left, right)
+# define METER_FRAMES(frames)
 
-            if (ch->play_state == STATE_PLAY)
-            {
-                if (ch->sample.position >= ch->sample.size)
-                {
-                    if (ch->sample.loop_end == ch->sample.loop_start)
-                    {
-                        ch->sample.position = 0;
-                        ch->play_state = STATE_STOP;
+#endif // UMOD_METERING
 
-                        // Remove this channel from the list
-                        for (int j = i; j < active_channels - 1; j++)
-                            active_ch[j] = active_ch[j + 1];
+void MixerMetersReset(void)
+{
+#ifdef UMOD_METERING
+    for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
+        mixer_channel[i].meter = (mixer_meter){ 0 };
 
-                        active_channels--;
+    master_meter = (mixer_meter){ 0 };
+    master_meter_frames = 0;
+#endif
+}
 
-                        break;
-                    }
-                    else
-                    {
-                        uint64_t len = ch->sample.size - ch->sample.loop_start;
+#ifdef UMOD_METERING
 
-                        ch->sample.position -= len;
+static uint16_t MixerMeterSqrt(uint32_t value)
+{
+    uint32_t result = 0;
+    uint32_t bit = 1U << 30;
 
-                        ch->play_state = STATE_LOOP;
-                    }
-                }
-            }
-            else // if (ch->play_state == STATE_LOOP)
-            {
-                while (ch->sample.position >= ch->sample.loop_end)
-                {
-                    uint64_t len = ch->sample.loop_end - ch->sample.loop_start;
+    while (bit > value)
+        bit >>= 2;
 
-                    ch->sample.position -= len;
-                }
-            }
+    while (bit != 0)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
         }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
     }
 
-    if (buffer_size == 0)
+    return result;
+}
+
+// The volume is the volume of the bus that the meter belongs to (0...256). It is
+// applied here instead of while mixing because it scales all levels the same way.
+static void MixerMeterGet(umod_meter *out, const mixer_meter *meter,
+                          uint32_t frames, int32_t volume)
+{
+    int32_t peak_left = (meter->peak_left * volume) >> 8;
+    int32_t peak_right = (meter->peak_right * volume) >> 8;
+
+    out->peak_left = peak_left > 32767 ? 32767 : peak_left;
+    out->peak_right = peak_right > 32767 ? 32767 : peak_right;
+
+    if (frames == 0)
+    {
+        out->rms_left = 0;
+        out->rms_right = 0;
         return;
+    }
 
-    while (buffer_size > 0)
+    // The squares are 30 bits at most, so the mean always fits in 32 bits
+    uint64_t volume_squared = volume * volume;
+    uint32_t mean_left = ((meter->sum_squares_left / frames) * volume_squared) >> 16;
+    uint32_t mean_right = ((meter->sum_squares_right / frames) * volume_squared) >> 16;
+
+    uint16_t rms_left = MixerMeterSqrt(mean_left);
+    uint16_t rms_right = MixerMeterSqrt(mean_right);
+
+    out->rms_left = rms_left > 32767 ? 32767 : rms_left;
+    out->rms_right = rms_right > 32767 ? 32767 : rms_right;
+}
+
+#endif // UMOD_METERING
+
+int UMOD_GetMeters(umod_meters *meters)
+{
+#ifdef UMOD_METERING
+    if (meters == NULL)
+        return -1;
+
+    for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
     {
-        int32_t total_left = 0;
-        int32_t total_right = 0;
+        mixer_channel_info *ch = &mixer_channel[i];
+
+        MixerMeterGet(&meters->channel[i], &ch->meter, master_meter_frames,
+                      mixer_bus[ch->bus].volume);
+    }
 
-        for (int i = 0; i < active_channels; i++)
+    MixerMeterGet(&meters->master, &master_meter, master_meter_frames, 256);
+
+    meters->frames = master_meter_frames;
+
+    return 0;
+#else
+    (void)meters;
+
+    return -1;
+#endif
+}
+
+// Mixer function
+// ==============
+
+// List of active channels of each bus
+typedef struct {
+    int                 channels[MIXER_BUSES];
+    mixer_channel_info *ch[MIXER_BUSES][MIXER_CHANNELS_MAX];
+} mixer_active_list;
+
+// Sets the position of a channel and wraps it around the loop if it has reached
+// the end of the sample or of the loop. The position may be past the end of the
+// loop by more than one loop if the increment is bigger than the size of the
+// loop, or if the channel has been advanced without mixing it. It returns 1 if
+// the channel has been stopped, 0 otherwise.
+//
+// Ping-pong and backward loops are wrapped around the part of the loop that is
+// played backwards too, which goes right after the end of the loop.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelSetPosition(mixer_channel_info *ch,
+                                          uint64_t position)
+{
+    // Empty loops are treated as if there was no loop at all
+    if (ch->sample.loop_end == ch->sample.loop_start)
+    {
+        if (position < ch->sample.size)
         {
-            mixer_channel_info *ch = active_ch[i];
+            ch->sample.position = position;
+            return 0;
+        }
 
-            // -128..127
-            int32_t value = ch->sample.pointer[ch->sample.position >> 12];
-            ch->sample.position += ch->sample.position_inc_per_sample;
+        ch->sample.position = 0;
+        MixerChannelSetState(ch, STATE_STOP);
+        mixer_channels_ended |= 1 << (ch - &mixer_channel[0]);
+
+        return 1;
+    }
 
-            total_left += value * ch->left_volume;
-            total_right += value * ch->right_volume;
+    if (ch->play_state == STATE_PLAY)
+    {
+        if (position < ch->sample.size)
+        {
+            ch->sample.position = position;
+            return 0;
         }
 
-        total_left >>= 2 + 8 + 8;  // 4 * max volume * max panning
-        total_right >>= 2 + 8 + 8; // 4 * max volume * max panning
+        // The end of the waveform is treated as the end of the loop, so
+        // ping-pong and backward loops continue backwards from there.
+        if (ch->sample.loop_type == MIXER_LOOP_FORWARD)
+            position = position - ch->sample.size + ch->sample.loop_start;
+        else
+            position = position - ch->sample.size + ch->sample.loop_end;
+        PROFILE_COUNT(loop_wraps);
+
+        MixerChannelSetState(ch, STATE_LOOP);
+    }
 
-        if (total_left < -128)
-            total_left = -128;
-        if (total_right < -128)
-            total_right = -128;
-        if (total_left > 127)
-            total_left = 127;
-        if (total_right > 127)
-            total_right = 127;
+    uint64_t loop_start = ch->sample.loop_start;
+    uint64_t loop_end = ch->sample.loop_end;
+    uint64_t len = loop_end - loop_start;
 
-        *left_buffer++ = total_left;
-        *right_buffer++ = total_right;
-        buffer_size--;
+    if (ch->sample.loop_type == MIXER_LOOP_PINGPONG)
+    {
+        loop_end += len;
+        len *= 2;
+    }
+    else if (ch->sample.loop_type == MIXER_LOOP_BACKWARD)
+    {
+        loop_start = loop_end;
+        loop_end += len;
     }
 
-    for (int i = 0; i < active_channels; i++)
+    if (position >= loop_end)
     {
-        mixer_channel_info *ch = active_ch[i];
+        uint64_t offset = position - loop_start;
 
-        if (ch->play_state == STATE_PLAY)
-        {
-            if (ch->sample.position >= ch->sample.size)
-            {
-                if (ch->sample.loop_end == ch->sample.loop_start)
-                {
-                    ch->sample.position = 0;
-                    ch->play_state = STATE_STOP;
+        // Avoid the 64-bit division if possible. The offset is bigger than the
+        // length of the loop, so the length fits in 32 bits too.
+        if ((offset >> 32) == 0)
+            offset = (uint32_t)offset % (uint32_t)len;
+        else
+            offset = offset % len;
 
-                    // Remove this channel from the list
-                    for (int j = i; j < active_channels - 1; j++)
-                        active_ch[j] = active_ch[j + 1];
+        position = loop_start + offset;
+        PROFILE_COUNT(loop_wraps);
+    }
 
-                    active_channels--;
+    ch->sample.position = position;
 
-                    break;
-                }
-                else
-                {
-                    uint64_t len = ch->sample.size - ch->sample.loop_start;
+    return 0;
+}
 
-                    ch->sample.position -= len;
+// Checks if a channel has reached the end of the sample or of the loop, and
+// wraps it around the loop if needed. It returns 1 if the channel has been
+// stopped, 0 otherwise.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelCheckEnd(mixer_channel_info *ch)
+{
+    return MixerChannelSetPosition(ch, ch->sample.position);
+}
 
-                    ch->play_state = STATE_LOOP;
-                }
-            }
-        }
-        else // if (ch->play_state == STATE_LOOP)
-        {
-            while (ch->sample.position >= ch->sample.loop_end)
-            {
-                uint64_t len = ch->sample.loop_end - ch->sample.loop_start;
+// Advances the position of a channel as if it had been mixed for the specified
+// number of frames, without reading the waveform. It returns 1 if the channel
+// has been stopped, 0 otherwise.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelAdvance(mixer_channel_info *ch, size_t frames)
+{
+    uint64_t position = ch->sample.position
+                      + (uint64_t)ch->sample.position_inc_per_sample * frames;
 
-                ch->sample.position -= len;
-            }
+    return MixerChannelSetPosition(ch, position);
+}
+
+// Returns 1 if the channel is in the part of a ping-pong or backward loop that
+// is played backwards, 0 otherwise.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelIsBackward(mixer_channel_info *ch)
+{
+    if ((ch->play_state != STATE_LOOP) ||
+        (ch->sample.loop_type == MIXER_LOOP_FORWARD) ||
+        (ch->sample.loop_end == ch->sample.loop_start))
+        return 0;
+
+    return ch->sample.position >= ch->sample.loop_end;
+}
+
+// Segments are mixed with a 20.12 position relative to the start of the
+// segment, so they can't span more than this.
+#define MIXER_SEGMENT_MAX   ((uint32_t)1 << 31) // 20.12
+
+// Returns the number of frames that can be mixed before the channel reaches the
+// end of the sample or of the loop, up to 'max_frames'. It must be called after
+// MixerChannelCheckEnd(), so that the channel is never mixed past that point.
+// Very long samples are split in several segments even if they don't end.
+ARM_CODE IWRAM_CODE
+static inline size_t MixerChannelFramesToEnd(mixer_channel_info *ch,
+                                             size_t max_frames)
+{
+    uint64_t end = ch->sample.size;
+    if ((ch->play_state == STATE_LOOP) &&
+        (ch->sample.loop_end != ch->sample.loop_start))
+        end = ch->sample.loop_end;
+
+    // The segment can't change direction
+    if (MixerChannelIsBackward(ch))
+        end += ch->sample.loop_end - ch->sample.loop_start;
+
+    uint32_t remaining = MIXER_SEGMENT_MAX;
+    if ((end - ch->sample.position) < MIXER_SEGMENT_MAX)
+        remaining = end - ch->sample.position;
+
+    uint32_t inc = ch->sample.position_inc_per_sample;
+
+    // Avoid the division if the end can't be reached in this block
+    if (remaining > (uint64_t)inc * (max_frames - 1))
+        return max_frames;
+
+    size_t frames = ((remaining - 1) / inc) + 1;
+    if (frames > max_frames)
+        frames = max_frames;
+
+    return frames;
+}
+
+// Sets the start of the segment to the current position of the channel. Only
+// the fractional part of the position is kept in the segment position. It must
+// be called after MixerChannelFramesToEnd(), and the segment can't be mixed for
+// more frames than that.
+//
+// Backwards segments start at the lowest position that can be read during the
+// segment, which is the start of the loop unless the segment is very long.
+ARM_CODE IWRAM_CODE
+static inline void MixerChannelSegmentStart(mixer_channel_info *ch)
+{
+    uint64_t position = ch->sample.position;
+    uint64_t start = position;
+
+    if (MixerChannelIsBackward(ch))
+    {
+        // Mirror the position. The end of the loop is mirrored to the last
+        // frame of the loop, and the end of the backwards part of the loop to
+        // the start of the loop.
+        position = 2 * ch->sample.loop_end - 1 - position;
+
+        start = ch->sample.loop_start;
+        if ((position - start) > MIXER_SEGMENT_MAX)
+            start = position - MIXER_SEGMENT_MAX;
+
+        ch->sample.segment_inc = -ch->sample.position_inc_per_sample;
+        ch->sample.segment_backward = 1;
+    }
+    else
+    {
+        ch->sample.segment_inc = ch->sample.position_inc_per_sample;
+        ch->sample.segment_backward = 0;
+    }
+
+    start &= ~(uint64_t)0xFFF;
+
+    size_t offset = (start >> 12) << ch->sample.frame_shift;
+
+    ch->sample.segment = &ch->sample.pointer[offset];
+    ch->sample.segment_position = position - start;
+    ch->sample.segment_start = ch->sample.segment_position;
+}
+
+// Updates the position of the channel with the position reached in the segment.
+ARM_CODE IWRAM_CODE
+static inline void MixerChannelSegmentEnd(mixer_channel_info *ch)
+{
+    uint32_t distance = ch->sample.segment_position - ch->sample.segment_start;
+
+    if (ch->sample.segment_backward)
+        distance = -distance;
+
+    ch->sample.position += distance;
+}
+
+// Checks all the channels of a bus and removes the ones that have been stopped
+// from the list.
+ARM_CODE IWRAM_CODE
+static inline void MixerBusCheckEnd(mixer_channel_info **active_ch,
+                                    int *active_channels)
+{
+    int i = 0;
+
+    while (i < *active_channels)
+    {
+        if (MixerChannelCheckEnd(active_ch[i]) == 0)
+        {
+            i++;
+            continue;
         }
+
+        // Remove this channel from the list
+        for (int j = i; j < *active_channels - 1; j++)
+            active_ch[j] = active_ch[j + 1];
+
+        (*active_channels)--;
     }
 }
+
+// Mix of all buses in one frame of one side of the output
+//
+// The mix of a bus multiplied by the volume of the bus doesn't fit in 32 bits.
+// The top bits and the lower 8 bits of the mix of each bus are multiplied by
+// the volume separately, and the lower part is added to the top part when the
+// frame is clamped. The result is the same as if all the buses had been added
+// with full precision, regardless of the number of buses and their volumes.
+typedef struct {
+    int32_t high;   // Sum of (bus >> 8) * bus volume
+    int32_t low;    // Sum of (bus & 0xFF) * bus volume
+} mixer_total;
+
+// Adds the mix of a bus to the total mix with the volume of the bus applied
+ARM_CODE IWRAM_CODE
+static inline void MixerTotalAddBus(mixer_total *total, int32_t bus,
+                                    int32_t volume)
+{
+    total->high += (bus >> 8) * volume;
+    total->low += (bus & 0xFF) * volume;
+}
+
+// Scales the mix of all buses down to the range of the output and clamps it.
+ARM_CODE IWRAM_CODE
+static inline int32_t MixerClampFrame(const mixer_total *total)
+{
+    // Total = sample * number of channels * volume * panning * bus volume
+    //       -128...127         8            0...255  0...255   0...256
+    //
+    // The bus volume is divided when the two parts of the total are added. The
+    // result needs to be scaled down and clamped to -128...127
+    //
+    // Divide by volume, panning first. Then, divide by a number smaller than
+    // the number of channels. 4 seems to be a good number to keep the volume
+    // up.
+
+    int32_t value = total->high + (total->low >> 8);
+
+    static_assert(MIXER_CHANNELS_MAX == (8 + 4),
+                  "Unexpected number of channels");
+    value >>= 2 + 8 + 8; // 4 * max volume * max panning
+
+    if (value < -128)
+        value = -128;
+    if (value > 127)
+        value = 127;
+
+    return value;
+}
+
+#ifdef UMOD_STEM_MIXING
+
+// Writes the contribution of a channel to one frame of the mix to its stem, if
+// the channel has one. The stem is scaled and clamped as if the channel was the
+// only one being played.
+ARM_CODE IWRAM_CODE
+static inline void MixerStemWrite(mixer_channel_info *ch, int32_t left,
+                                  int32_t right)
+{
+    if (ch->stem_left == NULL)
+        return;
+
+    int32_t volume = mixer_bus[ch->bus].volume;
+
+    mixer_total total_left = { 0, 0 };
+    MixerTotalAddBus(&total_left, left, volume);
+    *ch->stem_left++ = MixerClampFrame(&total_left);
+
+    if (ch->stem_right == NULL)
+        return;
+
+    mixer_total total_right = { 0, 0 };
+    MixerTotalAddBus(&total_right, right, volume);
+    *ch->stem_right++ = MixerClampFrame(&total_right);
+}
+
+# define STEM_WRITE(ch, left, right) \
+    MixerStemWrite(ch, left, right)
+
+#else // UMOD_STEM_MIXING
+
+# define STEM_WRITE(ch, left, right)
+
+#endif // UMOD_STEM_MIXING
+
+#ifdef UMOD_MIXER_VOICE_MAJOR
+
+// Voice-major mixer
+// -----------------
+//
+// Channels are mixed one at a time into 32-bit scratch buffers, so that the
+// state of the channel can be kept in registers. The result is converted to
+// the output format once all channels have been mixed. The result is the same
+// as the one of the frame-major mixer.
+//
+// Channels aren't split between threads. There are at most MIXER_CHANNELS_MAX
+// of them, and a call never mixes more than one song tick, so there is less
+// work per call than it costs to hand it over to another thread. Besides, the
+// end of a sample updates state shared by all channels. Long renders are split
+// in time instead (see the --jobs option of the renderer).
+
+#define MIXER_SCRATCH_FRAMES        256
+
+IWRAM_DATA static int32_t mixer_scratch_bus_left[MIXER_SCRATCH_FRAMES];
+IWRAM_DATA static int32_t mixer_scratch_bus_right[MIXER_SCRATCH_FRAMES];
+IWRAM_DATA static int32_t mixer_scratch_bus_center[MIXER_SCRATCH_FRAMES];
+IWRAM_DATA static mixer_total mixer_scratch_left[MIXER_SCRATCH_FRAMES];
+IWRAM_DATA static mixer_total mixer_scratch_right[MIXER_SCRATCH_FRAMES];
+
+#ifdef UMOD_STEM_MIXING
+// Stems are only used when rendering songs offline, so they don't need to be
+// in fast memory.
+EWRAM_BSS static int32_t mixer_scratch_stem_left[MIXER_SCRATCH_FRAMES];
+EWRAM_BSS static int32_t mixer_scratch_stem_right[MIXER_SCRATCH_FRAMES];
+#endif
+
+// Volumes used to mix a channel into the scratch buffers. In single mode the
+// output volume is used for samples with one channel, and the result is only
+// written to the left buffer.
+typedef struct {
+    int32_t out;
+    int32_t left;
+    int32_t right;
+#ifdef UMOD_METERING
+    int32_t meter_left;
+    int32_t meter_right;
+#endif
+} mixer_scratch_volume;
+
+// Adds one sample of a waveform with one channel to frame i of the scratch
+// buffers. The shift is 8 for 16-bit samples, to scale them down to the scale
+// of 8-bit samples.
+ARM_CODE IWRAM_CODE
+static inline void MixerScratchAddMono(mixer_channel_info *ch,
+                                       int32_t *restrict left,
+                                       int32_t *restrict right, size_t i,
+                                       int32_t value, int shift,
+                                       const mixer_scratch_volume *volume,
+                                       int single)
+{
+    (void)ch;
+
+    if (single)
+    {
+        left[i] += (value * volume->out) >> shift;
+    }
+    else
+    {
+        left[i] += (value * volume->left) >> shift;
+        right[i] += (value * volume->right) >> shift;
+    }
+
+    METER_CHANNEL(ch, (value * volume->meter_left) >> shift,
+                  (value * volume->meter_right) >> shift);
+}
+
+// Like MixerScratchAddMono(), but for one frame of a stereo waveform. Stereo
+// channels are only mixed in single mode in mono output mode, and the result is
+// the average of both sides.
+ARM_CODE IWRAM_CODE
+static inline void MixerScratchAddStereo(mixer_channel_info *ch,
+                                         int32_t *restrict left,
+                                         int32_t *restrict right, size_t i,
+                                         int32_t frame_left,
+                                         int32_t frame_right, int shift,
+                                         const mixer_scratch_volume *volume,
+                                         int single)
+{
+    (void)ch;
+
+    int32_t value_left = (frame_left * volume->left) >> shift;
+    int32_t value_right = (frame_right * volume->right) >> shift;
+
+    if (single)
+    {
+        int32_t value = (value_left + value_right) >> 1;
+
+        left[i] += value;
+        METER_CHANNEL(ch, value, value);
+    }
+    else
+    {
+        left[i] += value_left;
+        right[i] += value_right;
+        METER_CHANNEL(ch, value_left, value_right);
+    }
+}
+
+// Mixes a channel into the scratch buffers of a bus. The buffer is split in
+// segments that end right when the channel reaches the end of the sample or of
+// the loop, so that it never reads past the end of the waveform. It returns 1
+// if the channel has been stopped, 0 otherwise.
+//
+// Channels with an increment of 1.0, 0.5 or 2.0 samples per frame use kernels
+// that walk the waveform with a pointer instead of using the fixed point
+// position for every frame.
+//
+// In single mode the channel is only mixed into the left buffer, and right can
+// be NULL. The mode is passed as a constant from each caller, so that the
+// compiler can generate one version of the kernels for each.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelMixScratchKernels(mixer_channel_info *ch,
+                                                int32_t *restrict left,
+                                                int32_t *restrict right,
+                                                const mixer_scratch_volume *volume,
+                                                size_t frames, int single)
+{
+    while (frames > 0)
+    {
+        if (MixerChannelCheckEnd(ch))
+            return 1;
+
+        size_t size = MixerChannelFramesToEnd(ch, frames);
+
+        MixerChannelSegmentStart(ch);
+
+        uint32_t position = ch->sample.segment_position;
+        const uint32_t position_inc = ch->sample.segment_inc;
+        const int8_t *restrict src = ch->sample.segment;
+
+        // The kernels that walk the waveform with a pointer only go forwards
+        int kernel = ch->sample.kernel;
+        if (ch->sample.segment_backward &&
+            ((kernel == MIXER_KERNEL_UNITY) || (kernel == MIXER_KERNEL_HALF) ||
+             (kernel == MIXER_KERNEL_DOUBLE)))
+            kernel = MIXER_KERNEL_GENERIC;
+
+        switch (kernel)
+        {
+            case MIXER_KERNEL_UNITY:
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    MixerScratchAddMono(ch, left, right, i, src[i], 0, volume,
+                                        single);
+                }
+
+                position += size << 12;
+                break;
+            }
+            case MIXER_KERNEL_HALF:
+            {
+                // Every sample is used in two frames. If the fractional part of
+                // the position is 0.5 or more, the first sample is only used in
+                // the first frame.
+
+                size_t i = 0;
+
+                if ((position >> 11) & 1)
+                {
+                    MixerScratchAddMono(ch, left, right, i, *src++, 0, volume,
+                                        single);
+                    i++;
+                }
+
+                for ( ; i + 1 < size; i += 2)
+                {
+                    int32_t value = *src++;
+
+                    MixerScratchAddMono(ch, left, right, i, value, 0, volume,
+                                        single);
+                    MixerScratchAddMono(ch, left, right, i + 1, value, 0,
+                                        volume, single);
+                }
+
+                if (i < size)
+                {
+                    MixerScratchAddMono(ch, left, right, i, *src, 0, volume,
+                                        single);
+                }
+
+                position += size << 11;
+                break;
+            }
+            case MIXER_KERNEL_DOUBLE:
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    MixerScratchAddMono(ch, left, right, i, src[i * 2], 0,
+                                        volume, single);
+                }
+
+                position += size << 13;
+                break;
+            }
+            case MIXER_KERNEL_16_BIT:
+            {
+                const int16_t *restrict src16 = (const int16_t *)src;
+
+                for (size_t i = 0; i < size; i++)
+                {
+                    // -32768..32767
+                    int32_t value = src16[position >> 12];
+                    position += position_inc;
+
+                    MixerScratchAddMono(ch, left, right, i, value, 8, volume,
+                                        single);
+                }
+                break;
+            }
+            case MIXER_KERNEL_STEREO:
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    // -128..127
+                    const int8_t *frame = &src[(position >> 12) * 2];
+                    position += position_inc;
+
+                    MixerScratchAddStereo(ch, left, right, i, frame[0],
+                                          frame[1], 0, volume, single);
+                }
+                break;
+            }
+            case MIXER_KERNEL_STEREO_16_BIT:
+            {
+                const int16_t *restrict src16 = (const int16_t *)src;
+
+                for (size_t i = 0; i < size; i++)
+                {
+                    // -32768..32767
+                    const int16_t *frame = &src16[(position >> 12) * 2];
+                    position += position_inc;
+
+                    MixerScratchAddStereo(ch, left, right, i, frame[0],
+                                          frame[1], 8, volume, single);
+                }
+                break;
+            }
+            default:
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    // -128..127
+                    int32_t value = src[position >> 12];
+                    position += position_inc;
+
+                    MixerScratchAddMono(ch, left, right, i, value, 0, volume,
+                                        single);
+                }
+                break;
+            }
+        }
+
+        ch->sample.segment_position = position;
+        MixerChannelSegmentEnd(ch);
+
+        left += size;
+        if (!single)
+            right += size;
+        frames -= size;
+    }
+
+    return MixerChannelCheckEnd(ch);
+}
+
+// Mixes a channel into the left and right scratch buffers of a bus with its
+// left and right volumes.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelMixScratch(mixer_channel_info *ch,
+                                         int32_t *restrict left,
+                                         int32_t *restrict right,
+                                         size_t frames)
+{
+    const mixer_scratch_volume volume = {
+        .out = 0,
+        .left = ch->left_volume,
+        .right = ch->right_volume,
+#ifdef UMOD_METERING
+        .meter_left = ch->left_volume,
+        .meter_right = ch->right_volume,
+#endif
+    };
+
+    return MixerChannelMixScratchKernels(ch, left, right, &volume, frames, 0);
+}
+
+// Like MixerChannelMixScratch(), but it mixes the channel into a single buffer
+// with the specified volume. It is used for mono output, for channels that are
+// panned to one side, and for centered channels.
+ARM_CODE IWRAM_CODE
+static inline int MixerChannelMixScratchSingle(mixer_channel_info *ch,
+                                               int32_t *restrict out,
+                                               int32_t volume,
+                                               size_t frames)
+{
+    const mixer_scratch_volume single_volume = {
+        .out = volume,
+        .left = ch->left_volume,
+        .right = ch->right_volume,
+#ifdef UMOD_METERING
+        .meter_left = mixer_mono ? ch->mono_volume : ch->left_volume,
+        .meter_right = mixer_mono ? ch->mono_volume : ch->right_volume,
+#endif
+    };
+
+    return MixerChannelMixScratchKernels(ch, out, NULL, &single_volume, frames,
+                                         1);
+}
+
+#ifdef UMOD_STEM_MIXING
+
+// Mixes a channel that has a stem into its own scratch buffers, writes them to
+// the stem, and adds them to the scratch buffers of the bus. It returns 1 if the
+// channel has been stopped, 0 otherwise.
+ARM_CODE IWRAM_CODE
+static int MixerChannelMixStem(mixer_channel_info *ch, int32_t *bus_left,
+                               int32_t *bus_right, size_t frames, int mono)
+{
+    int32_t *stem_left = &mixer_scratch_stem_left[0];
+    int32_t *stem_right = &mixer_scratch_stem_right[0];
+    int ended;
+
+    memset(stem_left, 0, frames * sizeof(int32_t));
+
+    if (mono)
+    {
+        ended = MixerChannelMixScratchSingle(ch, stem_left, ch->mono_volume,
+                                             frames);
+
+        for (size_t f = 0; f < frames; f++)
+        {
+            bus_left[f] += stem_left[f];
+            MixerStemWrite(ch, stem_left[f], 0);
+        }
+    }
+    else
+    {
+        memset(stem_right, 0, frames * sizeof(int32_t));
+
+        ended = MixerChannelMixScratch(ch, stem_left, stem_right, frames);
+
+        for (size_t f = 0; f < frames; f++)
+        {
+            bus_left[f] += stem_left[f];
+            bus_right[f] += stem_right[f];
+            MixerStemWrite(ch, stem_left[f], stem_right[f]);
+        }
+    }
+
+    return ended;
+}
+
+#endif // UMOD_STEM_MIXING
+
+// In mono mode all channels are mixed into the left scratch buffers with their
+// mono volume, and the result is only written to the left buffer. The mode is
+// passed as a constant from each call site, so that the compiler can generate
+// one version of the mixer for each.
+ARM_CODE IWRAM_CODE
+static inline void MixerMixVoiceMajor(int8_t *left_buffer, int8_t *right_buffer,
+                                      size_t buffer_size,
+                                      mixer_active_list *active, int mono)
+{
+    while (buffer_size > 0)
+    {
+        size_t frames = buffer_size;
+        if (frames > MIXER_SCRATCH_FRAMES)
+            frames = MIXER_SCRATCH_FRAMES;
+
+        mixer_total *total_left = &mixer_scratch_left[0];
+        mixer_total *total_right = &mixer_scratch_right[0];
+
+        memset(total_left, 0, frames * sizeof(mixer_total));
+        if (!mono)
+            memset(total_right, 0, frames * sizeof(mixer_total));
+
+        for (int b = 0; b < MIXER_BUSES; b++)
+        {
+            mixer_channel_info **active_ch = active->ch[b];
+            int *active_channels = &active->channels[b];
+
+            if (*active_channels == 0)
+                continue;
+
+            int32_t *bus_left = &mixer_scratch_bus_left[0];
+            int32_t *bus_right = &mixer_scratch_bus_right[0];
+            int32_t *bus_center = &mixer_scratch_bus_center[0];
+
+            memset(bus_left, 0, frames * sizeof(int32_t));
+            if (!mono)
+                memset(bus_right, 0, frames * sizeof(int32_t));
+
+            // Centered channels are mixed together without panning, and the
+            // result is split into both sides at the end. This is only worth
+            // it if there are at least two of them.
+
+            int center_channels = 0;
+
+            if (!mono)
+            {
+                for (int i = 0; i < *active_channels; i++)
+                {
+                    if (active_ch[i]->pan_class == MIXER_PAN_CENTER)
+                        center_channels++;
+                }
+            }
+
+            int use_center = center_channels >= 2;
+
+            if (use_center)
+                memset(bus_center, 0, frames * sizeof(int32_t));
+
+            int i = 0;
+
+            while (i < *active_channels)
+            {
+                mixer_channel_info *ch = active_ch[i];
+                int pan_class = ch->pan_class;
+                int ended;
+
+#ifdef UMOD_STEM_MIXING
+                if (ch->stem_left != NULL)
+                {
+                    ended = MixerChannelMixStem(ch, bus_left, bus_right, frames,
+                                                mono);
+                }
+                else
+#endif
+                if (mono)
+                {
+                    ended = MixerChannelMixScratchSingle(ch, bus_left,
+                                                         ch->mono_volume,
+                                                         frames);
+                }
+                else if (pan_class == MIXER_PAN_LEFT)
+                {
+                    ended = MixerChannelMixScratchSingle(ch, bus_left,
+                                                         ch->left_volume,
+                                                         frames);
+                }
+                else if (pan_class == MIXER_PAN_RIGHT)
+                {
+                    ended = MixerChannelMixScratchSingle(ch, bus_right,
+                                                         ch->right_volume,
+                                                         frames);
+                }
+                else if ((pan_class == MIXER_PAN_CENTER) && use_center)
+                {
+                    ended = MixerChannelMixScratchSingle(ch, bus_center,
+                                                         ch->volume, frames);
+                }
+                else
+                {
+                    ended = MixerChannelMixScratch(ch, bus_left, bus_right,
+                                                   frames);
+                }
+
+                if (ended == 0)
+                {
+                    i++;
+                    continue;
+                }
+
+                // Remove this channel from the list
+                for (int j = i; j < *active_channels - 1; j++)
+                    active_ch[j] = active_ch[j + 1];
+
+                (*active_channels)--;
+            }
+
+            if (use_center)
+            {
+                for (size_t f = 0; f < frames; f++)
+                {
+                    bus_left[f] += bus_center[f] * MIXER_PAN_CENTER_LEFT;
+                    bus_right[f] += bus_center[f] * MIXER_PAN_CENTER_RIGHT;
+                }
+            }
+
+            // Any per-bus processing has to be done at this point
+
+            int32_t volume = mixer_bus[b].volume;
+
+            for (size_t f = 0; f < frames; f++)
+                MixerTotalAddBus(&total_left[f], bus_left[f], volume);
+
+            if (!mono)
+            {
+                for (size_t f = 0; f < frames; f++)
+                    MixerTotalAddBus(&total_right[f], bus_right[f], volume);
+            }
+        }
+
+        // Scale the result down and clamp it like in the frame-major mixer
+
+        if (mono)
+        {
+            for (size_t f = 0; f < frames; f++)
+            {
+                int32_t value = MixerClampFrame(&total_left[f]);
+
+                METER_MASTER(value, value);
+
+                left_buffer[f] = value;
+            }
+        }
+        else
+        {
+            for (size_t f = 0; f < frames; f++)
+            {
+                int32_t left = MixerClampFrame(&total_left[f]);
+                int32_t right = MixerClampFrame(&total_right[f]);
+
+                METER_MASTER(left, right);
+
+                left_buffer[f] = left;
+                right_buffer[f] = right;
+            }
+
+            right_buffer += frames;
+        }
+
+        left_buffer += frames;
+        buffer_size -= frames;
+    }
+}
+
+#else // UMOD_MIXER_VOICE_MAJOR
+
+// Frame-major mixer
+// -----------------
+//
+// All channels are mixed at the same time, a few frames at a time.
+
+// Reads the next frame of a channel with a format other than 8-bit mono, and
+// applies the left and right volumes to it. 16-bit samples are scaled down to
+// the scale of 8-bit samples after applying the volume.
+ARM_CODE IWRAM_CODE
+static inline void MixerChannelReadFrame(mixer_channel_info *ch,
+                                         int32_t *value_left,
+                                         int32_t *value_right)
+{
+    uint32_t index = ch->sample.segment_position >> 12;
+    ch->sample.segment_position += ch->sample.segment_inc;
+
+    if (ch->sample.format & MIXER_FORMAT_16_BIT)
+    {
+        const int16_t *segment = (const int16_t *)ch->sample.segment;
+
+        // -32768..32767
+        int32_t left, right;
+
+        if (ch->sample.format & MIXER_FORMAT_STEREO)
+        {
+            left = segment[index * 2];
+            right = segment[index * 2 + 1];
+        }
+        else
+        {
+            left = segment[index];
+            right = left;
+        }
+
+        *value_left = (left * ch->left_volume) >> 8;
+        *value_right = (right * ch->right_volume) >> 8;
+    }
+    else
+    {
+        // -128..127 (only stereo samples get here)
+        *value_left = ch->sample.segment[index * 2] * ch->left_volume;
+        *value_right = ch->sample.segment[index * 2 + 1] * ch->right_volume;
+    }
+}
+
+// Mixes the next frame of a channel with a format other than 8-bit mono. In
+// mono mode the result is only added to the left side, and stereo samples are
+// mixed as the average of both sides.
+ARM_CODE IWRAM_CODE
+static inline void MixerChannelMixFrameFormat(mixer_channel_info *ch, int mono,
+                                              int32_t *bus_left,
+                                              int32_t *bus_right)
+{
+    int32_t value_left, value_right;
+
+    if (mono && !(ch->sample.format & MIXER_FORMAT_STEREO))
+    {
+        const int16_t *segment = (const int16_t *)ch->sample.segment;
+
+        // -32768..32767
+        int32_t value = segment[ch->sample.segment_position >> 12];
+        ch->sample.segment_position += ch->sample.segment_inc;
+
+        value_left = (value * ch->mono_volume) >> 8;
+        value_right = value_left;
+    }
+    else
+    {
+        MixerChannelReadFrame(ch, &value_left, &value_right);
+
+        if (mono)
+        {
+            value_left = (value_left + value_right) >> 1;
+            value_right = value_left;
+        }
+    }
+
+    *bus_left += value_left;
+    if (!mono)
+        *bus_right += value_right;
+    METER_CHANNEL(ch, value_left, value_right);
+    STEM_WRITE(ch, value_left, value_right);
+}
+
+// In mono mode only the left accumulators are used, and the result is only
+// written to the left buffer. The mode is passed as a constant from each call
+// site, so that the compiler can generate one version of the mixer for each.
+ARM_CODE IWRAM_CODE
+static inline void MixerMixFrameMajor(int8_t *left_buffer, int8_t *right_buffer,
+                                      size_t buffer_size,
+                                      mixer_active_list *active, int mono)
+{
+    // Mix active channels
+    //
+    // The channels of each bus are added together, and the volume of the bus is
+    // applied to the result once per frame.
+
+    while (buffer_size > 0)
+    {
+        // Handle the channels that have reached the end of the sample or of the
+        // loop, and mix frames until the next channel reaches one of them.
+
+        size_t frames = buffer_size;
+
+        for (int b = 0; b < MIXER_BUSES; b++)
+        {
+            MixerBusCheckEnd(active->ch[b], &active->channels[b]);
+
+            for (int i = 0; i < active->channels[b]; i++)
+            {
+                frames = MixerChannelFramesToEnd(active->ch[b][i], frames);
+                MixerChannelSegmentStart(active->ch[b][i]);
+            }
+        }
+
+        buffer_size -= frames;
+
+        while (frames >= 4)
+        {
+            mixer_total total_left1 = { 0, 0 };
+            mixer_total total_right1 = { 0, 0 };
+            mixer_total total_left2 = { 0, 0 };
+            mixer_total total_right2 = { 0, 0 };
+            mixer_total total_left3 = { 0, 0 };
+            mixer_total total_right3 = { 0, 0 };
+            mixer_total total_left4 = { 0, 0 };
+            mixer_total total_right4 = { 0, 0 };
+
+            for (int b = 0; b < MIXER_BUSES; b++)
+            {
+                int channels = active->channels[b];
+
+                if (channels == 0)
+                    continue;
+
+                mixer_channel_info **active_ch = active->ch[b];
+
+                int32_t bus_left1 = 0;
+                int32_t bus_right1 = 0;
+                int32_t bus_left2 = 0;
+                int32_t bus_right2 = 0;
+                int32_t bus_left3 = 0;
+                int32_t bus_right3 = 0;
+                int32_t bus_left4 = 0;
+                int32_t bus_right4 = 0;
+
+                for (int i = 0; i < channels; i++)
+                {
+                    mixer_channel_info *ch = active_ch[i];
+
+                    if (ch->sample.format != MIXER_FORMAT_8_BIT)
+                    {
+                        MixerChannelMixFrameFormat(ch, mono, &bus_left1, &bus_right1);
+                        MixerChannelMixFrameFormat(ch, mono, &bus_left2, &bus_right2);
+                        MixerChannelMixFrameFormat(ch, mono, &bus_left3, &bus_right3);
+                        MixerChannelMixFrameFormat(ch, mono, &bus_left4, &bus_right4);
+                        continue;
+                    }
+
+                    const int8_t *segment = ch->sample.segment;
+                    uint32_t position = ch->sample.segment_position;
+                    uint32_t position_inc = ch->sample.segment_inc;
+
+                    // -128..127
+                    int32_t value1 = segment[position >> 12];
+                    position += position_inc;
+                    int32_t value2 = segment[position >> 12];
+                    position += position_inc;
+                    int32_t value3 = segment[position >> 12];
+                    position += position_inc;
+                    int32_t value4 = segment[position >> 12];
+                    position += position_inc;
+
+                    ch->sample.segment_position = position;
+
+                    if (mono)
+                    {
+                        int32_t mono_volume = ch->mono_volume;
+
+                        bus_left1 += value1 * mono_volume;
+                        bus_left2 += value2 * mono_volume;
+                        bus_left3 += value3 * mono_volume;
+                        bus_left4 += value4 * mono_volume;
+
+                        METER_CHANNEL(ch, value1 * mono_volume, value1 * mono_volume);
+                        METER_CHANNEL(ch, value2 * mono_volume, value2 * mono_volume);
+                        METER_CHANNEL(ch, value3 * mono_volume, value3 * mono_volume);
+                        METER_CHANNEL(ch, value4 * mono_volume, value4 * mono_volume);
+
+#ifdef UMOD_STEM_MIXING
+                        if (ch->stem_left != NULL)
+                        {
+                            MixerStemWrite(ch, value1 * mono_volume, 0);
+                            MixerStemWrite(ch, value2 * mono_volume, 0);
+                            MixerStemWrite(ch, value3 * mono_volume, 0);
+                            MixerStemWrite(ch, value4 * mono_volume, 0);
+                        }
+#endif
+                        continue;
+                    }
+
+                    int32_t left_volume = ch->left_volume;
+                    int32_t right_volume = ch->right_volume;
+
+                    bus_left1 += value1 * left_volume;
+                    bus_right1 += value1 * right_volume;
+                    bus_left2 += value2 * left_volume;
+                    bus_right2 += value2 * right_volume;
+                    bus_left3 += value3 * left_volume;
+                    bus_right3 += value3 * right_volume;
+                    bus_left4 += value4 * left_volume;
+                    bus_right4 += value4 * right_volume;
+
+                    METER_CHANNEL(ch, value1 * left_volume, value1 * right_volume);
+                    METER_CHANNEL(ch, value2 * left_volume, value2 * right_volume);
+                    METER_CHANNEL(ch, value3 * left_volume, value3 * right_volume);
+                    METER_CHANNEL(ch, value4 * left_volume, value4 * right_volume);
+
+#ifdef UMOD_STEM_MIXING
+                    if (ch->stem_left != NULL)
+                    {
+                        MixerStemWrite(ch, value1 * left_volume, value1 * right_volume);
+                        MixerStemWrite(ch, value2 * left_volume, value2 * right_volume);
+                        MixerStemWrite(ch, value3 * left_volume, value3 * right_volume);
+                        MixerStemWrite(ch, value4 * left_volume, value4 * right_volume);
+                    }
+#endif
+                }
+
+                // Any per-bus processing has to be done at this point
+
+                int32_t volume = mixer_bus[b].volume;
+
+                MixerTotalAddBus(&total_left1, bus_left1, volume);
+                MixerTotalAddBus(&total_left2, bus_left2, volume);
+                MixerTotalAddBus(&total_left3, bus_left3, volume);
+                MixerTotalAddBus(&total_left4, bus_left4, volume);
+
+                if (!mono)
+                {
+                    MixerTotalAddBus(&total_right1, bus_right1, volume);
+                    MixerTotalAddBus(&total_right2, bus_right2, volume);
+                    MixerTotalAddBus(&total_right3, bus_right3, volume);
+                    MixerTotalAddBus(&total_right4, bus_right4, volume);
+                }
+            }
+
+            int32_t left1 = MixerClampFrame(&total_left1);
+            int32_t left2 = MixerClampFrame(&total_left2);
+            int32_t left3 = MixerClampFrame(&total_left3);
+            int32_t left4 = MixerClampFrame(&total_left4);
+
+            *left_buffer++ = left1;
+            *left_buffer++ = left2;
+            *left_buffer++ = left3;
+            *left_buffer++ = left4;
+
+            if (mono)
+            {
+                METER_MASTER(left1, left1);
+                METER_MASTER(left2, left2);
+                METER_MASTER(left3, left3);
+                METER_MASTER(left4, left4);
+            }
+            else
+            {
+                int32_t right1 = MixerClampFrame(&total_right1);
+                int32_t right2 = MixerClampFrame(&total_right2);
+                int32_t right3 = MixerClampFrame(&total_right3);
+                int32_t right4 = MixerClampFrame(&total_right4);
+
+                METER_MASTER(left1, right1);
+                METER_MASTER(left2, right2);
+                METER_MASTER(left3, right3);
+                METER_MASTER(left4, right4);
+
+                *right_buffer++ = right1;
+                *right_buffer++ = right2;
+                *right_buffer++ = right3;
+                *right_buffer++ = right4;
+            }
+
+            frames -= 4;
+        }
+
+        while (frames > 0)
+        {
+            mixer_total total_left = { 0, 0 };
+            mixer_total total_right = { 0, 0 };
+
+            for (int b = 0; b < MIXER_BUSES; b++)
+            {
+                int channels = active->channels[b];
+
+                if (channels == 0)
+                    continue;
+
+                mixer_channel_info **active_ch = active->ch[b];
+
+                int32_t bus_left = 0;
+                int32_t bus_right = 0;
+
+                for (int i = 0; i < channels; i++)
+                {
+                    mixer_channel_info *ch = active_ch[i];
+
+                    if (ch->sample.format != MIXER_FORMAT_8_BIT)
+                    {
+                        MixerChannelMixFrameFormat(ch, mono, &bus_left, &bus_right);
+                        continue;
+                    }
+
+                    // -128..127
+                    int32_t value = ch->sample.segment[ch->sample.segment_position >> 12];
+                    ch->sample.segment_position += ch->sample.segment_inc;
+
+                    if (mono)
+                    {
+                        bus_left += value * ch->mono_volume;
+                        METER_CHANNEL(ch, value * ch->mono_volume,
+                                      value * ch->mono_volume);
+                        STEM_WRITE(ch, value * ch->mono_volume, 0);
+                        continue;
+                    }
+
+                    bus_left += value * ch->left_volume;
+                    bus_right += value * ch->right_volume;
+                    METER_CHANNEL(ch, value * ch->left_volume,
+                                  value * ch->right_volume);
+                    STEM_WRITE(ch, value * ch->left_volume,
+                               value * ch->right_volume);
+                }
+
+                int32_t volume = mixer_bus[b].volume;
+
+                MixerTotalAddBus(&total_left, bus_left, volume);
+                if (!mono)
+                    MixerTotalAddBus(&total_right, bus_right, volume);
+            }
+
+            int32_t left = MixerClampFrame(&total_left);
+
+            *left_buffer++ = left;
+
+            if (mono)
+            {
+                METER_MASTER(left, left);
+            }
+            else
+            {
+                int32_t right = MixerClampFrame(&total_right);
+
+                METER_MASTER(left, right);
+
+                *right_buffer++ = right;
+            }
+
+            frames--;
+        }
+
+        for (int b = 0; b < MIXER_BUSES; b++)
+        {
+            for (int i = 0; i < active->channels[b]; i++)
+                MixerChannelSegmentEnd(active->ch[b][i]);
+        }
+    }
+
+    for (int b = 0; b < MIXER_BUSES; b++)
+        MixerBusCheckEnd(active->ch[b], &active->channels[b]);
+}
+
+#endif // UMOD_MIXER_VOICE_MAJOR
+
+// Stems
+// =====
+
+#ifdef UMOD_STEM_MIXING
+
+// Buffers of the stems of each channel, or NULL if stems aren't being mixed.
+// The offset is the number of frames written to them since they were set.
+static int8_t *const *mixer_stems_left;
+static int8_t *const *mixer_stems_right;
+static size_t mixer_stems_offset;
+
+// Points each channel to the frames of its stem that are generated by the
+// current call to MixerMix(). The stems are cleared first, so they are silent in
+// the frames in which their channel isn't mixed.
+static void MixerStemsStart(size_t buffer_size)
+{
+    size_t offset = mixer_stems_offset;
+
+    for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
+    {
+        mixer_channel_info *ch = &mixer_channel[i];
+
+        ch->stem_left = NULL;
+        ch->stem_right = NULL;
+
+        if (mixer_stems_left[i] == NULL)
+            continue;
+
+        ch->stem_left = mixer_stems_left[i] + offset;
+        memset(ch->stem_left, 0, buffer_size);
+
+        if (!mixer_mono)
+        {
+            ch->stem_right = mixer_stems_right[i] + offset;
+            memset(ch->stem_right, 0, buffer_size);
+        }
+    }
+
+    mixer_stems_offset = offset + buffer_size;
+}
+
+#endif // UMOD_STEM_MIXING
+
+int MixerSetStems(int8_t *const *left, int8_t *const *right)
+{
+#ifdef UMOD_STEM_MIXING
+    if ((left != NULL) && !mixer_mono)
+    {
+        // Both sides of a stem are needed in stereo mode
+        for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
+        {
+            if ((left[i] != NULL) && ((right == NULL) || (right[i] == NULL)))
+                return -1;
+        }
+    }
+
+    mixer_stems_left = left;
+    mixer_stems_right = right;
+    mixer_stems_offset = 0;
+
+    if (left == NULL)
+    {
+        for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
+        {
+            mixer_channel[i].stem_left = NULL;
+            mixer_channel[i].stem_right = NULL;
+        }
+    }
+
+    return 0;
+#else
+    (void)right;
+
+    // Stems can only be disabled
+    return (left == NULL) ? 0 : -1;
+#endif
+}
+
+ARM_CODE IWRAM_CODE
+void MixerAdvance(size_t buffer_size, int mix_song)
+{
+    mixer_frame_counter += buffer_size;
+
+#ifdef UMOD_RECORDER
+    (void)mix_song;
+    return;
+#endif
+
+    // Advancing a channel can remove it from the list of playing channels, so
+    // the channels are gathered first.
+
+    int channels = 0;
+    mixer_channel_info *ch_list[MIXER_CHANNELS_MAX];
+
+    for (int i = 0; i < mixer_playing_channels; i++)
+    {
+        mixer_channel_info *ch = mixer_playing_ch[i];
+
+        if ((mix_song == 0) && (ch->owner == MIXER_OWNER_SONG))
+            continue;
+
+        if (ch->sample.pointer == NULL)
+            continue;
+
+        ch_list[channels++] = ch;
+    }
+
+    for (int i = 0; i < channels; i++)
+        MixerChannelAdvance(ch_list[i], buffer_size);
+}
+
+ARM_CODE IWRAM_CODE
+void MixerMix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size,
+              int mix_song)
+{
+    METER_FRAMES(buffer_size);
+
+    mixer_frame_counter += buffer_size;
+
+#ifdef UMOD_RECORDER
+    // Only the commands sent to the channels matter when recording
+    (void)left_buffer;
+    (void)right_buffer;
+    (void)mix_song;
+    return;
+#endif
+
+#ifdef UMOD_STEM_MIXING
+    if (mixer_stems_left != NULL)
+        MixerStemsStart(buffer_size);
+#endif
+
+    // Get list of all active channels of each bus
+
+    int active_channels = 0;
+    mixer_active_list active;
+
+    for (int b = 0; b < MIXER_BUSES; b++)
+        active.channels[b] = 0;
+
+    int silent_channels = 0;
+    mixer_channel_info *silent_ch[MIXER_CHANNELS_MAX];
+
+    for (int i = 0; i < mixer_playing_channels; i++)
+    {
+        mixer_channel_info *ch = mixer_playing_ch[i];
+
+        if ((mix_song == 0) && (ch->owner == MIXER_OWNER_SONG))
+            continue;
+
+        if (ch->sample.pointer == NULL)
+            continue;
+
+        // Channels that can't be heard don't need to be mixed. They are only
+        // advanced to where they would be at the end of the buffer.
+        int silent;
+        if (mixer_mono)
+            silent = (ch->mono_volume == 0);
+        else
+            silent = (ch->left_volume == 0) && (ch->right_volume == 0);
+
+        if (silent || (mixer_bus[ch->bus].volume == 0))
+        {
+            silent_ch[silent_channels++] = ch;
+            continue;
+        }
+
+        active.ch[ch->bus][active.channels[ch->bus]++] = ch;
+        active_channels++;
+    }
+
+    PROFILE_MAX(active_voices, active_channels);
+
+    for (int i = 0; i < silent_channels; i++)
+        MixerChannelAdvance(silent_ch[i], buffer_size);
+
+    if (active_channels == 0)
+    {
+        memset(left_buffer, 0, buffer_size);
+        if (!mixer_mono)
+            memset(right_buffer, 0, buffer_size);
+        return;
+    }
+
+#ifdef UMOD_MIXER_VOICE_MAJOR
+    if (mixer_mono)
+        MixerMixVoiceMajor(left_buffer, NULL, buffer_size, &active, 1);
+    else
+        MixerMixVoiceMajor(left_buffer, right_buffer, buffer_size, &active, 0);
+#else
+    if (mixer_mono)
+        MixerMixFrameMajor(left_buffer, NULL, buffer_size, &active, 1);
+    else
+        MixerMixFrameMajor(left_buffer, right_buffer, buffer_size, &active, 0);
+#endif
+}
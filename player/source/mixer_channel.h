@@ -15,36 +15,132 @@
 
 #define MIXER_CHANNELS_MAX      (UMOD_SONG_CHANNELS + UMOD_SFX_CHANNELS)
 
+#ifdef UMOD_METERING
+// Statistics accumulated during a render. 32768 is the full scale of the output
+// buffer.
 typedef struct {
-    int master_volume;
+    int32_t     peak_left;
+    int32_t     peak_right;
+    uint64_t    sum_squares_left;
+    uint64_t    sum_squares_right;
+} mixer_meter;
+#endif
+
+// Channels are mixed into one of several buses. Each bus has its own volume,
+// which is applied once per frame to the mix of all the channels in the bus.
+#define MIXER_BUSES             UMOD_BUSES
+
+typedef struct {
+    int volume;         // 0...256
+} mixer_bus_info;
+
+typedef struct mixer_channel_info {
+    int bus;
     int volume;         // 0...255
     int left_panning;   // 0...255
     int right_panning;  // 0...255
 
     // The following variables store the current overall volume to save time
     // during the mixing routine.
-    int left_volume;    // (master_volume * volume * left_panning) >> 8 = 0...65535
-    int right_volume;   // (master_volume * volume * right_panning) >> 8 = 0...65535
+    int left_volume;    // volume * left_panning = 0...65025
+    int right_volume;   // volume * right_panning = 0...65025
+    int mono_volume;    // (left_volume + right_volume) / 2 = 0...32512
+
+// Channels are classified depending on their panning so that the voice-major
+// mixer can do only one multiplication per frame when possible.
+#define MIXER_PAN_STEREO    0
+#define MIXER_PAN_CENTER    1 // Panning 128 (left and right panning below)
+#define MIXER_PAN_LEFT      2 // right_volume is 0
+#define MIXER_PAN_RIGHT     3 // left_volume is 0
+
+#define MIXER_PAN_CENTER_LEFT   (255 - 128)
+#define MIXER_PAN_CENTER_RIGHT  128
+
+    int pan_class;
 
 #define STATE_STOP 0
 #define STATE_PLAY 1
 #define STATE_LOOP 2
 
+#define MIXER_OWNER_SONG    0
+#define MIXER_OWNER_SFX     1
+
+    // Channels owned by the song aren't mixed while the song isn't playing.
+    int owner;
+
     // Set to loop after the first time the sample is played, if loop_start > 4
     // Note that in the mod file it would be 2, but the size is divided by 2
     // in the file, and it is multiplied by 2 by the packer.
     int play_state;
+    int playing_index; // Index in the list of playing channels if not stopped
 
-    struct {
-        int8_t     *pointer;    // Pointer to sample data (signed 8 bit)
-        uint32_t    size;       // 20.12
-        uint32_t    loop_start; // 20.12
-        uint32_t    loop_end;   // 20.12
+    // Detached channels are copies of mixer channels that are never mixed, and
+    // they are never added to the list of playing channels.
+    int detached;
 
-        uint32_t    position;   // 20.12 Position in the sample to read from
+    struct {
+        int8_t     *pointer;    // Pointer to sample data (signed 8 or 16 bit)
+        // Sizes and positions are in frames. A frame has one sample in mono
+        // waveforms, and two samples (left and right) in stereo waveforms.
+        uint64_t    size;       // 52.12
+        uint64_t    loop_start; // 52.12
+        uint64_t    loop_end;   // 52.12
+
+#define MIXER_LOOP_FORWARD      0
+#define MIXER_LOOP_PINGPONG     1 // Loop forwards and backwards
+#define MIXER_LOOP_BACKWARD     2 // Loop backwards only
+
+        int         loop_type;
+
+        // The position always increases. Once ping-pong and backward loops
+        // reach the end of the loop, the part of the loop that is played
+        // backwards goes from loop_end to loop_end + (loop_end - loop_start),
+        // and it is mirrored when the waveform is read.
+        uint64_t    position;   // 52.12 Position in the sample to read from
         uint32_t    position_inc_per_sample; // 20.12
+
+        // The mixer reads the waveform in segments. During a segment, the
+        // position is a 20.12 value relative to the start of the segment, so
+        // that samples of any size can be mixed with 32-bit arithmetic. The
+        // direction of a segment doesn't change, so segments that are played
+        // backwards just use a negative increment.
+        const int8_t *segment;  // Pointer to the start of the segment
+        uint32_t    segment_position; // 20.12
+        uint32_t    segment_start; // 20.12 Initial value of segment_position
+        uint32_t    segment_inc; // 20.12 Two's complement if it's backwards
+        int         segment_backward;
+
+#define MIXER_KERNEL_GENERIC    0
+#define MIXER_KERNEL_UNITY      1 // position_inc_per_sample is 1.0
+#define MIXER_KERNEL_HALF       2 // position_inc_per_sample is 0.5
+#define MIXER_KERNEL_DOUBLE     3 // position_inc_per_sample is 2.0
+#define MIXER_KERNEL_16_BIT     4 // 16-bit samples, any increment
+#define MIXER_KERNEL_STEREO     5 // 8-bit stereo samples, any increment
+#define MIXER_KERNEL_STEREO_16_BIT 6 // 16-bit stereo samples, any increment
+
+        // Mixing function used by the voice-major mixer
+        int         kernel;
+
+#define MIXER_FORMAT_8_BIT      0        // 8-bit mono samples
+#define MIXER_FORMAT_16_BIT     (1 << 0) // Flag: 16-bit samples
+#define MIXER_FORMAT_STEREO     (1 << 1) // Flag: Interleaved stereo samples
+
+        int         format;
+        int         frame_shift; // log2 of the size of a frame in bytes
     } sample;
 
+#ifdef UMOD_METERING
+    // Contribution of this channel to the current render, before clamping
+    mixer_meter meter;
+#endif
+
+#ifdef UMOD_STEM_MIXING
+    // Next frame of the stem of this channel in the current call to MixerMix(),
+    // or NULL if there is no stem. stem_right is always NULL in mono mode.
+    int8_t *stem_left;
+    int8_t *stem_right;
+#endif
+
 } mixer_channel_info;
 
 // Direct access functions
@@ -61,8 +157,35 @@ int MixerChannelSetInstrument(mixer_channel_info *ch, umodpack_instrument *instr
 int MixerChannelSetLoop(mixer_channel_info *ch, umod_loop_type loop_type,
                         size_t loop_start, size_t loop_end);
 int MixerChannelSetVolume(mixer_channel_info *ch, int volume);
-int MixerChannelSetMasterVolume(mixer_channel_info *ch, int volume);
 int MixerChannelSetPanning(mixer_channel_info *ch, int panning);
+int MixerChannelSetVolumePanning(mixer_channel_info *ch, int volume, int panning);
+int MixerChannelSetOwner(mixer_channel_info *ch, int owner);
+int MixerChannelSetBus(mixer_channel_info *ch, int bus);
+
+// Copies the state of a mixer channel to a detached channel, which can keep
+// being updated but is never mixed.
+void MixerChannelDetach(mixer_channel_info *copy, const mixer_channel_info *ch);
+// Restores the state of a mixer channel from a detached copy. The channel is
+// left stopped, so the note that was being played in the copy isn't resumed.
+void MixerChannelAttach(mixer_channel_info *ch, const mixer_channel_info *copy);
+
+// Output functions
+
+// In mono mode only the left buffer is used, with the average of the left and
+// right volumes of each channel.
+void MixerSetMono(int mono);
+
+// Bus functions
+
+int MixerBusSetVolume(int bus, int volume);
+
+// Returns a mask with one bit per mixer channel. Bits are set for the channels
+// that have been stopped by the mixer because their sample has ended since the
+// last call to this function.
+uint32_t MixerChannelsTakeEnded(void);
+
+// Returns the number of frames mixed since the start of the program.
+uint64_t MixerGetFrameCounter(void);
 
 // Mixer function
 
@@ -71,4 +194,25 @@ int MixerChannelSetPanning(mixer_channel_info *ch, int panning);
 void MixerMix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size,
               int mix_song);
 
+// Advances all channels as if MixerMix() had been called, without generating
+// any audio. The state of the channels afterwards is exactly the same.
+void MixerAdvance(size_t buffer_size, int mix_song);
+
+// Sets the buffers where the stems of each channel are written by the following
+// calls to MixerMix(), one after the other. There is one entry per mixer
+// channel, and entries can be NULL. In mono mode 'right' isn't used. Call it
+// with NULL to stop mixing stems. It returns 0 on success.
+//
+// The mixer writes the contribution of each channel to its stem at the same
+// time as it adds it to the master mix, so channels are only mixed once. Stems
+// are only supported if UMOD_STEM_MIXING is defined. If not, this function
+// fails unless it's called with NULL.
+int MixerSetStems(int8_t *const *left, int8_t *const *right);
+
+// Metering functions. They don't do anything unless UMOD_METERING is defined.
+
+// Clears the statistics of all channels and of the master output. It has to be
+// called at the start of each render.
+void MixerMetersReset(void);
+
 #endif // UMOD_MIXER_CHANNEL_H__
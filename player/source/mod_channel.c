@@ -12,6 +12,7 @@
 #include "definitions.h"
 #include "mixer_channel.h"
 #include "mod_channel.h"
+#include "sound_effect.h"
 
 typedef struct {
     int         note;
@@ -52,10 +53,18 @@ typedef struct {
     uint32_t                sample_offset; // Used for "Set Offset" effect
 
     mixer_channel_info     *ch;
+
+    // Set to 1 if the mixer channel of this song channel is used by the SFX
+    // player. It isn't cleared when the channel is reset.
+    int                     yielded;
 } mod_channel_info;
 
 static mod_channel_info mod_channel[UMOD_SONG_CHANNELS];
 
+// Yielded song channels keep updating their state in these mixer channels,
+// which are never mixed.
+static mixer_channel_info yielded_mixer_channel[UMOD_SONG_CHANNELS];
+
 // Taken from FMODDOC.TXT
 static const int16_t vibrato_tremolo_wave_sine[64] = {
        0,   24,   49,   74,   97,  120,  141,  161,
@@ -120,11 +129,27 @@ void ModChannelReset(int channel)
     mod_ch->effect_params = -1;
     mod_ch->panning = 128; // Middle
 
-    mod_ch->ch = MixerChannelGetFromIndex(channel);
+    // Clear the parameters remembered by effects, or a song played again would
+    // sound different than the first time.
+    mod_ch->vibrato_tick = 0;
+    mod_ch->vibrato_args = 0;
+    mod_ch->tremolo_tick = 0;
+    mod_ch->tremolo_args = 0;
+    mod_ch->porta_to_note_target_amiga_period = 0;
+    mod_ch->porta_to_note_speed = 0;
+    mod_ch->sample_offset = 0;
+
+    // Yielded channels keep using their detached mixer channel, the mixer
+    // channel is being used by the SFX player.
+    if (mod_ch->yielded)
+        mod_ch->ch = &yielded_mixer_channel[channel];
+    else
+        mod_ch->ch = MixerChannelGetFromIndex(channel);
 
     assert(mod_ch->ch != NULL);
 
     MixerChannelStop(mod_ch->ch);
+    MixerChannelSetBus(mod_ch->ch, UMOD_BUS_MUSIC);
 }
 
 void ModChannelResetAll(void)
@@ -135,19 +160,51 @@ void ModChannelResetAll(void)
 
 void UMOD_Song_SetMasterVolume(int volume)
 {
-    if (volume > 256)
-        volume = 256;
-    else if (volume < 0)
-        volume = 0;
+    MixerBusSetVolume(UMOD_BUS_MUSIC, volume);
+}
+
+int UMOD_Song_YieldChannels(int channels)
+{
+    if ((channels < 0) || (channels > UMOD_SONG_CHANNELS))
+        return -1;
+
+    int first_yielded = UMOD_SONG_CHANNELS - channels;
 
-    // Refresh volume of all channels
     for (int i = 0; i < UMOD_SONG_CHANNELS; i++)
     {
         mod_channel_info *mod_ch = &mod_channel[i];
-        mixer_channel_info *mixer_ch = mod_ch->ch;
+        mixer_channel_info *mixer_ch = MixerChannelGetFromIndex(i);
+
+        int yield = (i >= first_yielded) ? 1 : 0;
+
+        if (yield == mod_ch->yielded)
+            continue;
+
+        if (yield)
+        {
+            // Move the state of the channel to a mixer channel that isn't mixed
+            // so that the song can keep updating it.
+            MixerChannelDetach(&yielded_mixer_channel[i], mixer_ch);
+            mod_ch->ch = &yielded_mixer_channel[i];
 
-        MixerChannelSetMasterVolume(mixer_ch, volume);
+            SFX_ChannelAdd(i);
+        }
+        else
+        {
+            SFX_ChannelRemove(i);
+
+            // Restore the state of the channel, but don't resume the note that
+            // was being played. The channel will be heard from the next note.
+            MixerChannelAttach(mixer_ch, &yielded_mixer_channel[i]);
+            MixerChannelSetOwner(mixer_ch, MIXER_OWNER_SONG);
+            MixerChannelSetBus(mixer_ch, UMOD_BUS_MUSIC);
+            mod_ch->ch = mixer_ch;
+        }
+
+        mod_ch->yielded = yield;
     }
+
+    return 0;
 }
 
 // Table taken from:
@@ -189,7 +246,17 @@ static uint64_t convert_constant;
 
 void ModSetSampleRateConvertConstant(uint32_t sample_rate)
 {
+#ifdef UMOD_RECORDER
+    // When recording a compiled song, the periods sent to the mixer are Amiga
+    // periods in 20.12 format so that they don't depend on the sample rate. As
+    // the octave shift is never bigger than 12, they can be converted to real
+    // periods with ModGetSampleTickPeriodFromCompiled() without any rounding
+    // error.
+    (void)sample_rate;
+    convert_constant = 1 << 12;
+#else
     convert_constant = ((uint64_t)sample_rate << 34) / 14318181;
+#endif
 }
 
 // Returns the number of ticks needed to increase the sample read pointer in an
@@ -258,6 +325,70 @@ static uint64_t ModGetSampleTickPeriodFromAmigaPeriod(uint32_t amiga_period)
     return sample_tick_period;
 }
 
+// Converts a period of a compiled song to the period used by the mixer. The
+// result is the same as the one of ModGetSampleTickPeriod() and
+// ModGetSampleTickPeriodFromAmigaPeriod() for the same Amiga period.
+ARM_CODE
+uint64_t ModGetSampleTickPeriodFromCompiled(uint32_t period) // 20.12
+{
+    return ((uint64_t)period * convert_constant) >> 12;
+}
+
+mixer_channel_info *ModChannelGetMixerChannel(int channel)
+{
+    assert(channel < UMOD_SONG_CHANNELS);
+
+    return mod_channel[channel].ch;
+}
+
+#ifdef UMOD_RECORDER
+size_t ModChannelGetState(int64_t *state, size_t count, size_t max)
+{
+#define SAVE(value)                             \
+    do                                          \
+    {                                           \
+        if (count < max)                        \
+            state[count] = (int64_t)(value);    \
+        count++;                                \
+    } while (0)
+
+    // The mixer channel and the yielded flag aren't saved. They don't change
+    // the commands, only where they are sent.
+    for (int i = 0; i < UMOD_SONG_CHANNELS; i++)
+    {
+        mod_channel_info *mod_ch = &mod_channel[i];
+
+        SAVE(mod_ch->note);
+        SAVE(mod_ch->amiga_period);
+        SAVE(mod_ch->volume);
+        SAVE((uintptr_t)mod_ch->instrument_pointer);
+        SAVE(mod_ch->panning);
+        SAVE(mod_ch->effect);
+        SAVE(mod_ch->effect_params);
+        SAVE(mod_ch->arpeggio_tick);
+        SAVE(mod_ch->vibrato_tick);
+        SAVE(mod_ch->vibrato_args);
+        SAVE(mod_ch->tremolo_tick);
+        SAVE(mod_ch->tremolo_args);
+        SAVE(mod_ch->retrig_tick);
+        SAVE(mod_ch->porta_to_note_target_amiga_period);
+        SAVE(mod_ch->porta_to_note_speed);
+        SAVE((uintptr_t)mod_ch->vibrato_wave_table);
+        SAVE(mod_ch->vibrato_retrigger);
+        SAVE((uintptr_t)mod_ch->tremolo_wave_table);
+        SAVE(mod_ch->tremolo_retrigger);
+        SAVE(mod_ch->delayed_note);
+        SAVE(mod_ch->delayed_volume);
+        SAVE((uintptr_t)mod_ch->delayed_instrument);
+        SAVE(mod_ch->sample_offset);
+    }
+
+#undef SAVE
+
+    return count;
+}
+#endif
+
 void ModChannelSetNote(int channel, int note)
 {
     assert(channel < UMOD_SONG_CHANNELS);
@@ -5,9 +5,24 @@
 #ifndef UMOD_MOD_CHANNEL_H__
 #define UMOD_MOD_CHANNEL_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <umod/umodpack.h>
 
+typedef struct mixer_channel_info mixer_channel_info;
+
 void ModSetSampleRateConvertConstant(uint32_t sample_rate);
+uint64_t ModGetSampleTickPeriodFromCompiled(uint32_t period); // 20.12
+
+mixer_channel_info *ModChannelGetMixerChannel(int channel);
+
+#ifdef UMOD_RECORDER
+// Saves the fields of all song channels that affect the commands sent to the
+// mixer, one value per field, starting at state[count]. Values past 'max' are
+// counted but not saved. It returns the new count. Used to detect loops.
+size_t ModChannelGetState(int64_t *state, size_t count, size_t max);
+#endif
 
 void ModChannelResetAll(void);
 void ModChannelSetNote(int channel, int note);
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <umod/umod.h>
 #include <umod/umodpack.h>
@@ -13,6 +14,11 @@
 #include "global.h"
 #include "mixer_channel.h"
 #include "mod_channel.h"
+#include "profile.h"
+
+#ifdef UMOD_RECORDER
+# include <umod/umodrecorder.h>
+#endif
 
 // ============================================================================
 //                              Song API
@@ -34,13 +40,27 @@ typedef struct {
     int                 pattern_channels;
     int                 pattern_rows;
 
-    size_t      samples_per_tick; // Increment tick every X samples
+    // The length of a tick is sample_rate / (2 * BPM / 5) samples, which isn't
+    // a whole number in general. The integer part is used for every tick, and
+    // the remainder is accumulated so that some ticks are one sample longer.
+    // The remainder is stored as a fraction of 2 * BPM, so there's no rounding
+    // error and the song doesn't drift however long it is played.
+    size_t      samples_per_tick; // Integer part of the length of a tick
+    uint32_t    tick_remainder; // Remainder of the length of a tick
+    uint32_t    tick_divisor; // 2 * BPM
+    uint32_t    tick_error; // Accumulated remainder: 0 to tick_divisor - 1
     size_t      samples_left_for_tick;
 
     int         song_speed; // Ticks to advance to next row
     int         current_ticks; // Ticks elapsed in this row
     int         current_row;
     uint8_t    *pattern_position; // Current position inside pattern
+
+    // Compiled songs only
+    const uint8_t  *compiled_start; // NULL if the song isn't compiled
+    const uint8_t  *compiled_position;
+    int             compiled_empty_ticks; // Ticks left without commands
+    uint32_t        compiled_period[UMOD_SONG_CHANNELS]; // 20.12
 } song_state;
 
 static song_state loaded_song;
@@ -76,9 +96,24 @@ static void SetSpeed(int speed)
         uint32_t global_sample_rate = GetGlobalSampleRate();
 
         // Default is 125 BPM -> 50 Hz
-        int hz = (2 * speed) / 5;
-        loaded_song.samples_per_tick = global_sample_rate / hz;
-        loaded_song.samples_left_for_tick = loaded_song.samples_per_tick;
+        // samples_per_tick = sample_rate / (2 * BPM / 5)
+        uint32_t dividend = global_sample_rate * 5;
+        uint32_t divisor = 2 * speed;
+
+        // Keep the accumulated error when the tempo changes
+        if (loaded_song.tick_divisor != 0)
+        {
+            loaded_song.tick_error = ((uint64_t)loaded_song.tick_error * divisor)
+                                   / loaded_song.tick_divisor;
+        }
+
+        loaded_song.samples_per_tick = dividend / divisor;
+        loaded_song.tick_remainder = dividend % divisor;
+        loaded_song.tick_divisor = divisor;
+
+#ifdef UMOD_RECORDER
+        UMOD_Recorder_Command(0, COMMAND_TEMPO, speed);
+#endif
     }
     else
     {
@@ -111,6 +146,8 @@ int UMOD_Song_Play(uint32_t index)
     }
 
     // The default initial speed is 6 at 125 BPM
+    loaded_song.tick_divisor = 0;
+    loaded_song.tick_error = 0;
     SetSpeed(6);
     SetSpeed(125);
 
@@ -132,6 +169,18 @@ int UMOD_Song_Play(uint32_t index)
 
     ReloadPatternData();
 
+    loaded_song.compiled_start = NULL;
+    if (song->compiled_offset != 0)
+    {
+        loaded_song.compiled_start = (const uint8_t *)loaded_pack->data +
+                                     song->compiled_offset;
+        loaded_song.compiled_position = loaded_song.compiled_start;
+        loaded_song.compiled_empty_ticks = 0;
+
+        for (int c = 0; c < UMOD_SONG_CHANNELS; c++)
+            loaded_song.compiled_period[c] = 0;
+    }
+
     ModChannelResetAll();
 
     for (int c = 0; c < UMOD_SONG_CHANNELS; c++)
@@ -173,9 +222,122 @@ static int SeekRow(int row)
     return 0;
 }
 
+// Reads a little endian value from a compiled song
+static uint32_t CompiledRead(const uint8_t **position, int bytes)
+{
+    const uint8_t *p = *position;
+    uint32_t value = 0;
+
+    for (int i = 0; i < bytes; i++)
+        value |= (uint32_t)p[i] << (i * 8);
+
+    *position = p + bytes;
+
+    return value;
+}
+
+// Sends the commands of one tick of a compiled song to the mixer channels.
+// This replaces UMOD_Tick() for compiled songs.
+ARM_CODE IWRAM_CODE
+static void UMOD_TickCompiled(void)
+{
+    PROFILE_COUNT(ticks);
+
+    if (loaded_song.compiled_empty_ticks > 0)
+    {
+        loaded_song.compiled_empty_ticks--;
+        return;
+    }
+
+    const uint8_t *position = loaded_song.compiled_position;
+
+    while (1)
+    {
+        uint8_t command = *position++;
+        int channel = command & 0xF;
+        mixer_channel_info *ch = NULL;
+        uint32_t *period = NULL;
+
+        // The low bits are a count in some commands, not a channel
+        if (channel < UMOD_SONG_CHANNELS)
+        {
+            ch = ModChannelGetMixerChannel(channel);
+            period = &loaded_song.compiled_period[channel];
+        }
+
+        switch (command >> 4)
+        {
+            case COMMAND_END_TICK:
+                loaded_song.compiled_empty_ticks = channel;
+                loaded_song.compiled_position = position;
+                return;
+
+            case COMMAND_NOTE_PERIOD:
+                *period = CompiledRead(&position, 4);
+                MixerChannelSetNotePeriod(ch,
+                        ModGetSampleTickPeriodFromCompiled(*period));
+                break;
+
+            case COMMAND_PORTA_PERIOD:
+                *period = CompiledRead(&position, 4);
+                MixerChannelSetNotePeriodPorta(ch,
+                        ModGetSampleTickPeriodFromCompiled(*period));
+                break;
+
+            case COMMAND_PORTA_DELTA:
+                *period += (int16_t)CompiledRead(&position, 2);
+                MixerChannelSetNotePeriodPorta(ch,
+                        ModGetSampleTickPeriodFromCompiled(*period));
+                break;
+
+            case COMMAND_VOLUME:
+                MixerChannelSetVolume(ch, *position++);
+                break;
+
+            case COMMAND_PANNING:
+                MixerChannelSetPanning(ch, *position++);
+                break;
+
+            case COMMAND_INSTRUMENT:
+                MixerChannelSetInstrument(ch,
+                        InstrumentGetPointer(CompiledRead(&position, 2)));
+                break;
+
+            case COMMAND_SAMPLE_OFFSET:
+                MixerChannelSetSampleOffset(ch, CompiledRead(&position, 4));
+                break;
+
+            case COMMAND_STOP:
+                MixerChannelStop(ch);
+                break;
+
+            case COMMAND_TEMPO:
+                SetSpeed(*position++);
+                break;
+
+            case COMMAND_JUMP:
+                position = loaded_song.compiled_start +
+                           CompiledRead(&position, 4);
+                break;
+
+            case COMMAND_SONG_END:
+            default:
+                loaded_song.state = STATE_STOPPED;
+                ModChannelResetAll();
+                return;
+        }
+    }
+}
+
 ARM_CODE IWRAM_CODE
 static void UMOD_Tick(void)
 {
+    PROFILE_COUNT(ticks);
+
+#ifdef UMOD_RECORDER
+    UMOD_Recorder_TickStart();
+#endif
+
     loaded_song.current_ticks++;
 
     if (loaded_song.current_ticks < loaded_song.song_speed)
@@ -203,12 +365,18 @@ static void UMOD_Tick(void)
         }
     }
 
+#ifdef UMOD_RECORDER
+    UMOD_Recorder_RowStart(loaded_song.current_pattern, loaded_song.current_row);
+#endif
+
     int jump_to_pattern = -1;
     int pattern_break = -1;
 
     //printf("%d/%d : ", loaded_song.current_row, loaded_song.pattern_rows);
     //setvbuf(stdout, 0, _IONBF, 0);
 
+    PROFILE_START(decode);
+
     for (int c = 0; c < loaded_song.pattern_channels; c++)
     {
         uint8_t flags = *loaded_song.pattern_position++;
@@ -300,6 +468,8 @@ static void UMOD_Tick(void)
 
     //printf("\n");
 
+    PROFILE_END(decode, decode_time);
+
     ModChannelUpdateAllTick_T0();
 
     if (jump_to_pattern >= 0)
@@ -375,11 +545,78 @@ int UMOD_Song_Resume(void)
     return 1;
 }
 
+#ifdef UMOD_RECORDER
+size_t UMOD_Recorder_GetState(void *buffer, size_t size)
+{
+    int64_t *state = buffer;
+    size_t max = size / sizeof(int64_t);
+    size_t count = 0;
+
+#define SAVE(value)                             \
+    do                                          \
+    {                                           \
+        if (count < max)                        \
+            state[count] = (int64_t)(value);    \
+        count++;                                \
+    } while (0)
+
+    // The accumulated remainder of the tick length isn't saved. It changes the
+    // length of the ticks, not the commands sent in them.
+    SAVE(loaded_song.state);
+    SAVE(loaded_song.current_pattern);
+    SAVE(loaded_song.current_row);
+    SAVE(loaded_song.current_ticks);
+    SAVE(loaded_song.song_speed);
+    SAVE(loaded_song.samples_per_tick);
+    SAVE(loaded_song.tick_remainder);
+    SAVE(loaded_song.tick_divisor);
+    SAVE((uintptr_t)loaded_song.pattern_position);
+
+#undef SAVE
+
+    count = ModChannelGetState(state, count, max);
+
+    return count * sizeof(int64_t);
+}
+#endif
+
 // ============================================================================
 //                              Mixer API
 // ============================================================================
 
-void UMOD_Mix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size)
+// Returns the number of samples until the next tick. Ticks are one sample longer
+// than samples_per_tick when the accumulated remainder reaches a whole sample.
+static size_t GetTickLength(void)
+{
+    size_t length = loaded_song.samples_per_tick;
+
+    loaded_song.tick_error += loaded_song.tick_remainder;
+    if (loaded_song.tick_error >= loaded_song.tick_divisor)
+    {
+        loaded_song.tick_error -= loaded_song.tick_divisor;
+        length++;
+    }
+
+    return length;
+}
+
+// Mixes channels into the buffers. If left_buffer is NULL, the channels are
+// only advanced, and no audio is generated.
+static void MixFrames(int8_t *left_buffer, int8_t *right_buffer, size_t size,
+                      int mix_song)
+{
+    if (left_buffer == NULL)
+        MixerAdvance(size, mix_song);
+    else
+        MixerMix(left_buffer, right_buffer, size, mix_song);
+}
+
+// Fills the buffers updating the song when a tick ends. It doesn't reset the
+// meters or save the profiling statistics, so it can be called several times to
+// fill the parts of one render. If left_buffer is NULL, the song is updated but
+// no audio is generated.
+static void MixBuffer(int8_t *left_buffer, int8_t *right_buffer,
+                      size_t buffer_size)
 {
     while (buffer_size > 0)
     {
@@ -387,36 +624,117 @@ void UMOD_Mix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size)
         {
             // If the song isn't being played, it isn't needed to call
             // UMOD_Tick(), so just call the mixer to fill all the buffer.
-            MixerMix(left_buffer, right_buffer, buffer_size, 0);
+            PROFILE_START(mix);
+            MixFrames(left_buffer, right_buffer, buffer_size, 0);
+            PROFILE_END(mix, mix_time);
             break;
         }
         else
         {
             if (loaded_song.samples_left_for_tick == 0)
             {
-                UMOD_Tick();
-                loaded_song.samples_left_for_tick = loaded_song.samples_per_tick;
+                PROFILE_START(tick);
+                if (loaded_song.compiled_start != NULL)
+                    UMOD_TickCompiled();
+                else
+                    UMOD_Tick();
+                PROFILE_END(tick, tick_time);
+                loaded_song.samples_left_for_tick = GetTickLength();
             }
 
             if (buffer_size >= loaded_song.samples_left_for_tick)
             {
                 size_t size = loaded_song.samples_left_for_tick;
 
-                MixerMix(left_buffer, right_buffer, size, 1);
-                left_buffer += size;
-                right_buffer += size;
+                PROFILE_START(mix);
+                MixFrames(left_buffer, right_buffer, size, 1);
+                PROFILE_END(mix, mix_time);
+                if (left_buffer != NULL)
+                    left_buffer += size;
+                if (right_buffer != NULL) // It can be NULL in mono mode
+                    right_buffer += size;
                 buffer_size -= size;
 
                 loaded_song.samples_left_for_tick = 0;
             }
             else // if (buffer_size < loaded_song.samples_left_for_tick)
             {
-                MixerMix(left_buffer, right_buffer, buffer_size, 1);
+                PROFILE_START(mix);
+                MixFrames(left_buffer, right_buffer, buffer_size, 1);
+                PROFILE_END(mix, mix_time);
 
                 loaded_song.samples_left_for_tick -= buffer_size;
 
-                return;
+                break;
             }
         }
     }
 }
+
+void UMOD_Mix(int8_t *left_buffer, int8_t *right_buffer, size_t buffer_size)
+{
+    MixerMetersReset();
+
+    MixBuffer(left_buffer, right_buffer, buffer_size);
+
+    ProfileRenderEnd();
+}
+
+void UMOD_Skip(size_t buffer_size)
+{
+    MixerMetersReset();
+
+    MixBuffer(NULL, NULL, buffer_size);
+
+    ProfileRenderEnd();
+}
+
+int UMOD_MixStems(int8_t *left_buffer, int8_t *right_buffer,
+                  int8_t *const stems_left[UMOD_STEMS],
+                  int8_t *const stems_right[UMOD_STEMS], size_t buffer_size)
+{
+    if (stems_left == NULL)
+        return -1;
+
+    if (MixerSetStems(stems_left, stems_right) != 0)
+        return -1;
+
+    MixerMetersReset();
+
+    MixBuffer(left_buffer, right_buffer, buffer_size);
+
+    ProfileRenderEnd();
+
+    MixerSetStems(NULL, NULL);
+
+    return 0;
+}
+
+int UMOD_MixRing(int8_t *left_base, int8_t *right_base, size_t capacity,
+                 size_t write_index, size_t frames)
+{
+    if ((capacity == 0) || (frames > capacity))
+        return -1;
+
+    size_t offset = write_index % capacity;
+
+    // Split the render at the end of the ring buffer. The state of the current
+    // tick is kept between both parts, so the output is the same as if the
+    // buffer was linear.
+
+    size_t size = capacity - offset;
+    if (size > frames)
+        size = frames;
+
+    MixerMetersReset();
+
+    MixBuffer(&left_base[offset],
+              (right_base != NULL) ? &right_base[offset] : NULL, size);
+
+    if (size < frames)
+        MixBuffer(left_base, right_base, frames - size);
+
+    ProfileRenderEnd();
+
+    return 0;
+}
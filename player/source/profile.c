@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#if defined(UMOD_PROFILING) && !defined(__GBA__)
+// Needed for clock_gettime() when building in C11 mode
+# define _POSIX_C_SOURCE 199309L
+# include <time.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <umod/umod.h>
+
+#include "definitions.h"
+#include "profile.h"
+
+#ifdef UMOD_PROFILING
+
+umod_profile profile_data;
+static umod_profile profile_last;
+
+#ifdef __GBA__
+
+// Timers 2 and 3 are cascaded to get a 32-bit counter that increments once per
+// CPU cycle. Timers 0 and 1 are left free because they are the only ones that
+// can be used to drive the sound FIFOs.
+
+#define REG_TM2CNT_L    (*(volatile uint16_t *)0x04000108)
+#define REG_TM2CNT_H    (*(volatile uint16_t *)0x0400010A)
+#define REG_TM3CNT_L    (*(volatile uint16_t *)0x0400010C)
+#define REG_TM3CNT_H    (*(volatile uint16_t *)0x0400010E)
+
+#define TIMER_CASCADE   (1 << 2)
+#define TIMER_START     (1 << 7)
+
+static void ProfileTimerInit(void)
+{
+    REG_TM2CNT_H = 0;
+    REG_TM3CNT_H = 0;
+
+    REG_TM2CNT_L = 0;
+    REG_TM3CNT_L = 0;
+
+    REG_TM3CNT_H = TIMER_START | TIMER_CASCADE;
+    REG_TM2CNT_H = TIMER_START;
+}
+
+uint32_t ProfileTimerRead(void)
+{
+    uint16_t high, low;
+
+    // Make sure that the low timer doesn't overflow between both reads
+    do {
+        high = REG_TM3CNT_L;
+        low = REG_TM2CNT_L;
+    } while (high != REG_TM3CNT_L);
+
+    return ((uint32_t)high << 16) | low;
+}
+
+#else // __GBA__
+
+static void ProfileTimerInit(void)
+{
+    // Nothing to do
+}
+
+uint32_t ProfileTimerRead(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)ts.tv_sec * 1000000000U + (uint32_t)ts.tv_nsec;
+}
+
+#endif // __GBA__
+
+#endif // UMOD_PROFILING
+
+void ProfileInit(void)
+{
+#ifdef UMOD_PROFILING
+    ProfileTimerInit();
+
+    profile_data = (umod_profile){ 0 };
+    profile_last = (umod_profile){ 0 };
+#endif
+}
+
+void ProfileRenderEnd(void)
+{
+#ifdef UMOD_PROFILING
+    profile_last = profile_data;
+    profile_data = (umod_profile){ 0 };
+#endif
+}
+
+int UMOD_GetProfile(umod_profile *profile)
+{
+#ifdef UMOD_PROFILING
+    if (profile == NULL)
+        return -1;
+
+    *profile = profile_last;
+
+    return 0;
+#else
+    (void)profile;
+
+    return -1;
+#endif
+}
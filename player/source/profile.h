@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#ifndef UMOD_PROFILE_H__
+#define UMOD_PROFILE_H__
+
+#include <stdint.h>
+
+#include <umod/umod.h>
+
+// Profiling functions. They don't do anything unless UMOD_PROFILING is defined.
+
+// Starts the timer used for profiling.
+void ProfileInit(void);
+
+// Saves the statistics gathered since the last call so that they can be read
+// with UMOD_GetProfile(), and clears them. It has to be called at the end of
+// each render. Anything that happens between two renders (like SFX being
+// started) is accounted for in the next render.
+void ProfileRenderEnd(void);
+
+#ifdef UMOD_PROFILING
+
+extern umod_profile profile_data;
+
+// Returns the current value of the timer. On GBA it counts CPU cycles, in any
+// other platform it counts nanoseconds. It is only used to calculate time
+// differences, so it doesn't matter if it overflows.
+uint32_t ProfileTimerRead(void);
+
+# define PROFILE_START(name) \
+    uint32_t profile_start_##name = ProfileTimerRead()
+# define PROFILE_END(name, field) \
+    profile_data.field += ProfileTimerRead() - profile_start_##name
+# define PROFILE_COUNT(field) \
+    profile_data.field++
+# define PROFILE_MAX(field, value) \
+    do { \
+        if (profile_data.field < (value)) \
+            profile_data.field = (value); \
+    } while (0)
+
+#else
+
+# define PROFILE_START(name)
+# define PROFILE_END(name, field)
+# define PROFILE_COUNT(field)
+# define PROFILE_MAX(field, value)
+
+#endif // UMOD_PROFILING
+
+#endif // UMOD_PROFILE_H__
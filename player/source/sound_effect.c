@@ -11,6 +11,8 @@
 #include "definitions.h"
 #include "global.h"
 #include "mixer_channel.h"
+#include "profile.h"
+#include "sound_effect.h"
 
 typedef struct {
 
@@ -28,11 +30,54 @@ typedef struct {
     // used.
     int released;
 
+    // Priority given when the SFX was started, and current volume of the SFX
+    // after applying the volume of its group. They are used to decide which
+    // channel to stop when all of them are used.
+    int priority;
+    int volume;
+
+    // Values set by the owner of the SFX, before applying the group settings
+    int group;
+    int sfx_volume;             // 0...255
+    int sfx_panning;            // 0...255
+    uint32_t sfx_multiplier;    // 16.16
+
+    // Frequency multiplier currently used by the mixer channel (16.16)
+    uint32_t multiplier;
+
+    // Frame of the mixer clock in which the SFX started
+    uint64_t start_frame;
+
+    // Key used to sort the channels in the heap. Channels with lower keys are
+    // stopped first when a new SFX needs a channel.
+    uint64_t steal_key;
+
+    // Set to 1 if the remaining length used to calculate the steal key has been
+    // capped, so the key gets stale as the SFX is played.
+    int steal_key_capped;
+
+    // Index of this channel in the heap of active channels. It is -1 if the
+    // channel isn't in the heap.
+    int heap_index;
+
+    // Set to 1 if the mixer channel can be used by the SFX player.
+    int available;
+
 } sfx_channel_info;
 
-// TODO: Use only MIXER_SFX_CHANNELS
+// This array is indexed by mixer channel, not by SFX channel. Only the SFX
+// channels are normally used, but the song may yield some of its channels.
 static sfx_channel_info sfx_channel[MIXER_CHANNELS_MAX];
 
+typedef struct {
+    int bus;
+    int volume;             // 0...256
+    int panning;            // 0...255 (128 leaves the panning unchanged)
+    uint32_t multiplier;    // 16.16
+} sfx_group_info;
+
+static sfx_group_info sfx_group[UMOD_SFX_GROUPS];
+
 // A handle is formed by two uint16_t values packed in one uint32_t. The top
 // uint16_t is a counter that increments by one whenever a new handle is
 // requested. The lower uint16_t is the mixer channel the handle corresponds to.
@@ -56,40 +101,284 @@ static umod_handle SFX_GenerateHandle(uint32_t channel)
     return handle;
 }
 
-// Returns a channel number. On error, it returns -1
-static int SFX_MixerChannelAllocate(void)
+// Channel allocation
+// ==================
+//
+// Channels that aren't playing anything are kept in a stack. Channels that are
+// playing a SFX are kept in a binary min-heap sorted by their steal key, so
+// that the best channel to steal is always at the top.
+//
+// Channels whose sample ends are stopped by the mixer, which only flags them.
+// They are moved from the heap to the stack the next time that a channel is
+// allocated, so the cost of allocating a channel is O(1) amortized.
+
+static int free_channel[MIXER_CHANNELS_MAX];
+static int free_channels;
+
+static int heap_channel[MIXER_CHANNELS_MAX];
+static int heap_channels;
+
+// Released channels are always stolen before any other channel. After that,
+// channels with lower priorities are stolen first.
+#define STEAL_KEY_ACTIVE_SHIFT      62
+#define STEAL_KEY_PRIORITY_SHIFT    54
+#define STEAL_KEY_SCORE_MASK        (((uint64_t)1 << STEAL_KEY_PRIORITY_SHIFT) - 1)
+
+// Maximum remaining length (in seconds) considered for a channel. Looping
+// channels are considered to have this length. It is short enough that a quiet
+// looping channel is stolen before a loud channel that is about to end.
+#define STEAL_REMAINING_MAX_SECONDS 2
+
+// Between channels with the same priority, the score is a weighted sum of the
+// remaining length of the SFX, its volume and its age. Channels that are about
+// to end, quiet channels and old channels get lower scores:
+//
+//   score = 2 * remaining + volume * (sample_rate / 64) - age
+//
+// With remaining = end_frame - now and age = now - start_frame, this is:
+//
+//   score = 2 * end_frame + start_frame + volume * (sample_rate / 64) - 3 * now
+//
+// The current frame is the same for all channels, so it can be left out. That
+// way, the keys only need to be updated when the volume or the frequency of a
+// channel change.
+//
+// This isn't true for looping channels and long SFX. Their remaining length is
+// capped, so their end frame moves forward as they are played. Their keys are
+// refreshed right before a channel is stolen.
+static void SFX_RefreshStealKey(sfx_channel_info *sfx)
 {
-    // First, look for any free channel.
+    mixer_channel_info *ch = sfx->ch;
 
-    for (int i = UMOD_SONG_CHANNELS; i < MIXER_CHANNELS_MAX; i++)
+    uint64_t remaining_max = (uint64_t)GetGlobalSampleRate() *
+                             STEAL_REMAINING_MAX_SECONDS;
+    uint64_t remaining = remaining_max;
+    int capped = 1;
+
+    if ((ch->play_state == STATE_PLAY) &&
+        (ch->sample.loop_start == ch->sample.loop_end))
     {
-        mixer_channel_info *ch = MixerChannelGetFromIndex(i);
+        remaining = 0;
+        capped = 0;
+
+        if (ch->sample.position < ch->sample.size)
+        {
+            uint64_t left = ch->sample.size - ch->sample.position; // 52.12
+            remaining = left / ch->sample.position_inc_per_sample;
+            if (remaining > remaining_max)
+            {
+                remaining = remaining_max;
+                capped = 1;
+            }
+        }
+    }
+
+    uint64_t end_frame = MixerGetFrameCounter() + remaining;
+
+    uint64_t score = 2 * end_frame + sfx->start_frame +
+                     (uint64_t)sfx->volume * (GetGlobalSampleRate() >> 6);
+
+    uint64_t key = score & STEAL_KEY_SCORE_MASK;
+    key |= (uint64_t)sfx->priority << STEAL_KEY_PRIORITY_SHIFT;
+    if (sfx->released == 0)
+        key |= (uint64_t)1 << STEAL_KEY_ACTIVE_SHIFT;
+
+    sfx->steal_key = key;
+    sfx->steal_key_capped = capped;
+}
 
-        if (MixerChannelIsPlaying(ch))
+static void SFX_HeapSet(int index, int channel)
+{
+    heap_channel[index] = channel;
+    sfx_channel[channel].heap_index = index;
+}
+
+static uint64_t SFX_HeapKey(int index)
+{
+    return sfx_channel[heap_channel[index]].steal_key;
+}
+
+static void SFX_HeapSiftUp(int index)
+{
+    int channel = heap_channel[index];
+    uint64_t key = sfx_channel[channel].steal_key;
+
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+
+        if (SFX_HeapKey(parent) <= key)
+            break;
+
+        SFX_HeapSet(index, heap_channel[parent]);
+        index = parent;
+    }
+
+    SFX_HeapSet(index, channel);
+}
+
+static void SFX_HeapSiftDown(int index)
+{
+    int channel = heap_channel[index];
+    uint64_t key = sfx_channel[channel].steal_key;
+
+    while (1)
+    {
+        int child = index * 2 + 1;
+
+        if (child >= heap_channels)
+            break;
+
+        if ((child + 1 < heap_channels) &&
+            (SFX_HeapKey(child + 1) < SFX_HeapKey(child)))
+        {
+            child++;
+        }
+
+        if (key <= SFX_HeapKey(child))
+            break;
+
+        SFX_HeapSet(index, heap_channel[child]);
+        index = child;
+    }
+
+    SFX_HeapSet(index, channel);
+}
+
+static void SFX_HeapInsert(int channel)
+{
+    assert(sfx_channel[channel].heap_index == -1);
+
+    int index = heap_channels++;
+    SFX_HeapSet(index, channel);
+    SFX_HeapSiftUp(index);
+}
+
+static void SFX_HeapRemove(int channel)
+{
+    int index = sfx_channel[channel].heap_index;
+    assert(index >= 0);
+
+    sfx_channel[channel].heap_index = -1;
+
+    heap_channels--;
+    if (index == heap_channels)
+        return;
+
+    // Move the last element to the empty slot and restore the heap
+    int moved = heap_channel[heap_channels];
+    SFX_HeapSet(index, moved);
+    SFX_HeapSiftUp(index);
+    SFX_HeapSiftDown(sfx_channel[moved].heap_index);
+}
+
+// Call this whenever the steal key of an active channel changes.
+static void SFX_HeapUpdate(int channel)
+{
+    sfx_channel_info *sfx = &sfx_channel[channel];
+
+    SFX_RefreshStealKey(sfx);
+
+    if (sfx->heap_index == -1)
+        return;
+
+    SFX_HeapSiftUp(sfx->heap_index);
+    SFX_HeapSiftDown(sfx->heap_index);
+}
+
+// Sorts the whole heap again. This is cheaper than updating channels one by one
+// when the keys of many channels change at the same time.
+static void SFX_HeapBuild(void)
+{
+    for (int i = (heap_channels / 2) - 1; i >= 0; i--)
+        SFX_HeapSiftDown(i);
+}
+
+// Refreshes the keys of all channels whose keys get stale as they are played,
+// and sorts the heap again if any of them has changed.
+static void SFX_HeapRefreshCapped(void)
+{
+    int refreshed = 0;
+
+    for (int i = 0; i < heap_channels; i++)
+    {
+        sfx_channel_info *sfx = &sfx_channel[heap_channel[i]];
+
+        if (sfx->steal_key_capped == 0)
             continue;
 
-        return i;
+        SFX_RefreshStealKey(sfx);
+        refreshed = 1;
     }
 
-    // Now, as all channels are being used, check if any of them has been
-    // released.
+    if (refreshed)
+        SFX_HeapBuild();
+}
+
+static void SFX_FreeChannelPush(int channel)
+{
+    assert(free_channels < MIXER_CHANNELS_MAX);
+
+    free_channel[free_channels++] = channel;
+}
 
-    for (int i = UMOD_SONG_CHANNELS; i < MIXER_CHANNELS_MAX; i++)
+// Moves all channels that have been stopped by the mixer to the free stack.
+static void SFX_CollectEndedChannels(void)
+{
+    uint32_t mask = MixerChannelsTakeEnded();
+
+    for (int i = 0; mask != 0; i++, mask >>= 1)
     {
+        if ((mask & 1) == 0)
+            continue;
+
         sfx_channel_info *sfx = &sfx_channel[i];
 
-        if (sfx->released == 0)
+        // Ignore channels that belong to the song and channels that have been
+        // stopped and reused since the mixer flagged them.
+        if (sfx->heap_index == -1)
             continue;
 
-        mixer_channel_info *ch = MixerChannelGetFromIndex(i);
-
-        MixerChannelStop(ch);
+        if (MixerChannelIsPlaying(sfx->ch))
+            continue;
 
-        return i;
+        SFX_HeapRemove(i);
+        SFX_FreeChannelPush(i);
     }
+}
+
+// Returns a channel number. On error, it returns -1
+static int SFX_MixerChannelAllocate(int priority)
+{
+    SFX_CollectEndedChannels();
+
+    // First, look for any free channel.
+
+    if (free_channels > 0)
+        return free_channel[--free_channels];
 
-    // No channel found
-    return -1;
+    // Now, as all channels are being used, check if the channel with the lowest
+    // key can be stolen. Released channels can always be stolen. Other channels
+    // can only be stolen by a SFX with a higher priority.
+
+    if (heap_channels == 0)
+        return -1;
+
+    SFX_HeapRefreshCapped();
+
+    int channel = heap_channel[0];
+    sfx_channel_info *sfx = &sfx_channel[channel];
+
+    if ((sfx->released == 0) && (sfx->priority >= priority))
+        return -1;
+
+    SFX_HeapRemove(channel);
+
+    MixerChannelStop(sfx->ch);
+
+    PROFILE_COUNT(voice_steals);
+
+    return channel;
 }
 
 static sfx_channel_info *SFX_MixerChannelGet(umod_handle handle)
@@ -99,7 +388,8 @@ static sfx_channel_info *SFX_MixerChannelGet(umod_handle handle)
 
     uint32_t channel = handle & 0xFFFF;
 
-    // TODO: Check if channel is within range.
+    if (channel >= MIXER_CHANNELS_MAX)
+        return NULL;
 
     sfx_channel_info *sfx = &sfx_channel[channel];
 
@@ -110,42 +400,195 @@ static sfx_channel_info *SFX_MixerChannelGet(umod_handle handle)
     return sfx;
 }
 
+// Parameters of a SFX
+// ===================
+//
+// The values set by the owner of a SFX are combined with the values of its
+// group before they are passed to the mixer. With the default group values the
+// result is the same as the value set by the owner.
+
+static int SFX_Clamp(int value, int min, int max)
+{
+    if (value > max)
+        return max;
+    else if (value < min)
+        return min;
+
+    return value;
+}
+
+// Updates the volume, panning and bus of the mixer channel. It doesn't update the
+// steal key of the channel.
+static void SFX_ApplyVolumePanning(sfx_channel_info *sfx)
+{
+    sfx_group_info *group = &sfx_group[sfx->group];
+
+    sfx->volume = (sfx->sfx_volume * group->volume) >> 8;
+
+    int panning = SFX_Clamp(sfx->sfx_panning + group->panning - 128, 0, 255);
+
+    MixerChannelSetVolumePanning(sfx->ch, sfx->volume, panning);
+    MixerChannelSetBus(sfx->ch, group->bus);
+}
+
+// Returns the period that corresponds to the current multiplier of the SFX.
+static uint64_t SFX_GetPeriod(sfx_channel_info *sfx)
+{
+    uint32_t frequency = (sfx->multiplier *
+                          (uint64_t)sfx->instrument->frequency) >> 16;
+    if (frequency == 0)
+        frequency = 1;
+
+    uint64_t sample_rate = (uint64_t)GetGlobalSampleRate();
+
+    // 32.32 / 64.0 = 32.32
+    return (sample_rate << 32) / frequency;
+}
+
+// Updates the frequency of the mixer channel without restarting the sample. It
+// doesn't update the steal key of the channel. It returns 1 if the frequency
+// has changed, 0 otherwise.
+static int SFX_ApplyFrequency(sfx_channel_info *sfx)
+{
+    uint32_t multiplier = ((uint64_t)sfx->sfx_multiplier *
+                           sfx_group[sfx->group].multiplier) >> 16;
+
+    // Avoid the division if nothing has changed
+    if (multiplier == sfx->multiplier)
+        return 0;
+
+    sfx->multiplier = multiplier;
+
+    MixerChannelSetNotePeriodPorta(sfx->ch, SFX_GetPeriod(sfx)); // 32.32
+
+    return 1;
+}
+
+// Internal functions
+// ==================
+
+void SFX_ChannelAdd(int channel)
+{
+    sfx_channel_info *sfx = &sfx_channel[channel];
+
+    if (sfx->available)
+        return;
+
+    mixer_channel_info *ch = MixerChannelGetFromIndex(channel);
+    assert(ch != NULL);
+
+    MixerChannelStop(ch);
+    MixerChannelSetOwner(ch, MIXER_OWNER_SFX);
+
+    sfx->ch = ch;
+    sfx->handle = UMOD_HANDLE_INVALID;
+    sfx->heap_index = -1;
+    sfx->available = 1;
+
+    SFX_FreeChannelPush(channel);
+}
+
+void SFX_ChannelRemove(int channel)
+{
+    sfx_channel_info *sfx = &sfx_channel[channel];
+
+    if (sfx->available == 0)
+        return;
+
+    if (sfx->heap_index != -1)
+    {
+        SFX_HeapRemove(channel);
+    }
+    else
+    {
+        for (int i = 0; i < free_channels; i++)
+        {
+            if (free_channel[i] == channel)
+            {
+                free_channel[i] = free_channel[--free_channels];
+                break;
+            }
+        }
+    }
+
+    MixerChannelStop(sfx->ch);
+
+    // Invalidate the handle so that it can't affect the new owner
+    sfx->handle = UMOD_HANDLE_INVALID;
+    sfx->available = 0;
+}
+
+void SFX_Init(void)
+{
+    free_channels = 0;
+    heap_channels = 0;
+
+    for (int i = 0; i < UMOD_SFX_GROUPS; i++)
+    {
+        sfx_group[i].bus = UMOD_BUS_SFX;
+        sfx_group[i].volume = 256;
+        sfx_group[i].panning = 128;
+        sfx_group[i].multiplier = 1 << 16;
+    }
+
+    // Song channels that have been yielded are returned by the song code
+    for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
+    {
+        sfx_channel_info *sfx = &sfx_channel[i];
+
+        sfx->handle = UMOD_HANDLE_INVALID;
+        sfx->heap_index = -1;
+        sfx->available = 0;
+    }
+
+    // Add channels in reverse order so that the first channel is used first
+    for (int i = MIXER_CHANNELS_MAX - 1; i >= UMOD_SONG_CHANNELS; i--)
+        SFX_ChannelAdd(i);
+
+    // Discard the channels that have been flagged before this point
+    MixerChannelsTakeEnded();
+}
+
 // ============================================================================
 //                              SFX API
 // ============================================================================
 
 void UMOD_SFX_SetMasterVolume(int volume)
 {
-    if (volume > 256)
-        volume = 256;
-    else if (volume < 0)
-        volume = 0;
-
-    // Refresh volume of all channels
-    for (int i = UMOD_SONG_CHANNELS; i < MIXER_CHANNELS_MAX; i++)
-    {
-        mixer_channel_info *mixer_ch = MixerChannelGetFromIndex(i);
-        MixerChannelSetMasterVolume(mixer_ch, volume);
-    }
+    MixerBusSetVolume(UMOD_BUS_SFX, volume);
 }
 
 umod_handle UMOD_SFX_Play(uint32_t index, umod_loop_type loop_type)
+{
+    return UMOD_SFX_PlayPriority(index, loop_type, UMOD_SFX_PRIORITY_DEFAULT);
+}
+
+umod_handle UMOD_SFX_PlayPriority(uint32_t index, umod_loop_type loop_type,
+                                  int priority)
+{
+    return UMOD_SFX_PlayGroup(index, loop_type, priority, UMOD_SFX_GROUP_DEFAULT);
+}
+
+umod_handle UMOD_SFX_PlayGroup(uint32_t index, umod_loop_type loop_type,
+                               int priority, int group)
 {
     umod_loaded_pack *loaded_pack = GetLoadedPack();
 
     if (index >= loaded_pack->num_instruments)
         return UMOD_HANDLE_INVALID;
 
-    int channel = SFX_MixerChannelAllocate();
+    if ((group < 0) || (group >= UMOD_SFX_GROUPS))
+        return UMOD_HANDLE_INVALID;
+
+    priority = SFX_Clamp(priority, 0, 255);
+
+    int channel = SFX_MixerChannelAllocate(priority);
 
     if (channel == -1)
         return UMOD_HANDLE_INVALID;
 
     umod_handle handle = SFX_GenerateHandle(channel);
 
-    if (handle == UMOD_HANDLE_INVALID)
-        return UMOD_HANDLE_INVALID;
-
     sfx_channel_info *sfx = &sfx_channel[channel];
 
     // Save handle to be able to verify that the sound being played in channel X
@@ -156,14 +599,18 @@ umod_handle UMOD_SFX_Play(uint32_t index, umod_loop_type loop_type)
     // Set as high priority.
 
     sfx->released = 0;
+    sfx->priority = priority;
+    sfx->start_frame = MixerGetFrameCounter();
 
-    // Save pointer to mixer channel for easier access.
+    sfx->group = group;
+    sfx->sfx_volume = 255;
+    sfx->sfx_panning = 128;
+    sfx->sfx_multiplier = 1 << 16;
+    sfx->multiplier = sfx_group[group].multiplier;
 
-    mixer_channel_info *ch = MixerChannelGetFromIndex(channel);
+    mixer_channel_info *ch = sfx->ch;
     assert(ch != NULL);
 
-    sfx->ch = ch;
-
     // Save the original instrument in order to be able to return to the
     // default values (frequency, etc)
 
@@ -174,17 +621,11 @@ umod_handle UMOD_SFX_Play(uint32_t index, umod_loop_type loop_type)
 
     // Calculate note period
 
-    uint64_t sample_rate = (uint64_t)GetGlobalSampleRate();
-
-    // 32.32 / 64.0 = 32.32
-    uint64_t period = (sample_rate << 32) / instrument_pointer->frequency;
-
-    MixerChannelSetNotePeriod(ch, period); // 32.32
+    MixerChannelSetNotePeriod(ch, SFX_GetPeriod(sfx)); // 32.32
 
     // Set remaining values of the mixer channel
 
-    MixerChannelSetVolume(ch, 255);
-    MixerChannelSetPanning(ch, 128);
+    SFX_ApplyVolumePanning(sfx);
 
     MixerChannelStart(ch);
 
@@ -207,6 +648,9 @@ umod_handle UMOD_SFX_Play(uint32_t index, umod_loop_type loop_type)
         }
     }
 
+    SFX_RefreshStealKey(sfx);
+    SFX_HeapInsert(channel);
+
     return handle;
 }
 
@@ -222,12 +666,10 @@ int UMOD_SFX_SetVolume(umod_handle handle, int volume)
     if (MixerChannelIsPlaying(sfx->ch) == 0)
         return -1;
 
-    if (volume > 255)
-        volume = 255;
-    else if (volume < 0)
-        volume = 0;
+    sfx->sfx_volume = SFX_Clamp(volume, 0, 255);
 
-    MixerChannelSetVolume(sfx->ch, volume);
+    SFX_ApplyVolumePanning(sfx);
+    SFX_HeapUpdate(handle & 0xFFFF);
 
     return 0;
 }
@@ -239,17 +681,14 @@ int UMOD_SFX_SetPanning(umod_handle handle, int panning)
     if (sfx == NULL)
         return -1;
 
-    if (panning > 255)
-        panning = 255;
-    else if (panning < 0)
-        panning = 0;
-
     assert(sfx->ch);
 
     if (MixerChannelIsPlaying(sfx->ch) == 0)
         return -1;
 
-    MixerChannelSetPanning(sfx->ch, panning);
+    sfx->sfx_panning = SFX_Clamp(panning, 0, 255);
+
+    SFX_ApplyVolumePanning(sfx);
 
     return 0;
 }
@@ -270,16 +709,56 @@ int UMOD_SFX_SetFrequencyMultiplier(umod_handle handle, uint32_t multiplier)
     if (MixerChannelIsPlaying(sfx->ch) == 0)
         return -1;
 
-    uint32_t frequency = (multiplier * (uint64_t)sfx->instrument->frequency) >> 16;
+    sfx->sfx_multiplier = multiplier;
 
-    uint64_t sample_rate = (uint64_t)GetGlobalSampleRate();
+    // The remaining length of the SFX has changed
+    if (SFX_ApplyFrequency(sfx))
+        SFX_HeapUpdate(handle & 0xFFFF);
 
-    // 32.32 / 64.0 = 32.32
-    uint64_t period = (sample_rate << 32) / frequency;
+    return 0;
+}
 
-    MixerChannelSetNotePeriodPorta(sfx->ch, period); // 32.32
+int UMOD_SFX_Update(const umod_sfx_update *updates, size_t count)
+{
+    int ret = 0;
+    int keys_changed = 0;
 
-    return 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const umod_sfx_update *update = &updates[i];
+
+        sfx_channel_info *sfx = SFX_MixerChannelGet(update->handle);
+
+        if ((sfx == NULL) || (MixerChannelIsPlaying(sfx->ch) == 0))
+        {
+            ret = -1;
+            continue;
+        }
+
+        if (update->volume >= 0)
+            sfx->sfx_volume = SFX_Clamp(update->volume, 0, 255);
+
+        if (update->panning >= 0)
+            sfx->sfx_panning = SFX_Clamp(update->panning, 0, 255);
+
+        if ((update->volume >= 0) || (update->panning >= 0))
+            SFX_ApplyVolumePanning(sfx);
+
+        if (update->frequency_multiplier != 0)
+        {
+            sfx->sfx_multiplier = update->frequency_multiplier;
+            SFX_ApplyFrequency(sfx);
+        }
+
+        // The heap is sorted once all the channels have been updated
+        SFX_RefreshStealKey(sfx);
+        keys_changed = 1;
+    }
+
+    if (keys_changed)
+        SFX_HeapBuild();
+
+    return ret;
 }
 
 int UMOD_SFX_Release(umod_handle handle)
@@ -296,6 +775,8 @@ int UMOD_SFX_Release(umod_handle handle)
 
     sfx->released = 1;
 
+    SFX_HeapUpdate(handle & 0xFFFF);
+
     return 0;
 }
 
@@ -325,18 +806,139 @@ int UMOD_SFX_Stop(umod_handle handle)
 
     MixerChannelStop(sfx->ch);
 
+    uint32_t channel = handle & 0xFFFF;
+    SFX_HeapRemove(channel);
+    SFX_FreeChannelPush(channel);
+
     return 0;
 }
 
 void UMOD_SFX_StopAll(void)
 {
-    for (int i = UMOD_SONG_CHANNELS; i < MIXER_CHANNELS_MAX; i++)
+    for (int i = 0; i < MIXER_CHANNELS_MAX; i++)
     {
         sfx_channel_info *sfx = &sfx_channel[i];
 
+        if (sfx->heap_index == -1)
+            continue;
+
         assert(sfx->ch);
 
         if (MixerChannelIsPlaying(sfx->ch))
             MixerChannelStop(sfx->ch);
+
+        SFX_HeapRemove(i);
+        SFX_FreeChannelPush(i);
+    }
+}
+
+// ============================================================================
+//                              SFX Groups API
+// ============================================================================
+
+int UMOD_SFX_SetGroup(umod_handle handle, int group)
+{
+    if ((group < 0) || (group >= UMOD_SFX_GROUPS))
+        return -1;
+
+    sfx_channel_info *sfx = SFX_MixerChannelGet(handle);
+
+    if (sfx == NULL)
+        return -1;
+
+    assert(sfx->ch);
+
+    if (MixerChannelIsPlaying(sfx->ch) == 0)
+        return -1;
+
+    sfx->group = group;
+
+    SFX_ApplyVolumePanning(sfx);
+    SFX_ApplyFrequency(sfx);
+    SFX_HeapUpdate(handle & 0xFFFF);
+
+    return 0;
+}
+
+// Applies the settings of a group to all the SFX that belong to it.
+static void SFX_GroupRefresh(int group, int frequency)
+{
+    int keys_changed = 0;
+
+    for (int i = 0; i < heap_channels; i++)
+    {
+        sfx_channel_info *sfx = &sfx_channel[heap_channel[i]];
+
+        if (sfx->group != group)
+            continue;
+
+        if (MixerChannelIsPlaying(sfx->ch) == 0)
+            continue;
+
+        if (frequency)
+            SFX_ApplyFrequency(sfx);
+        else
+            SFX_ApplyVolumePanning(sfx);
+
+        SFX_RefreshStealKey(sfx);
+        keys_changed = 1;
     }
+
+    // Don't sort the heap while iterating it
+    if (keys_changed)
+        SFX_HeapBuild();
+}
+
+int UMOD_SFX_GroupSetVolume(int group, int volume)
+{
+    if ((group < 0) || (group >= UMOD_SFX_GROUPS))
+        return -1;
+
+    sfx_group[group].volume = SFX_Clamp(volume, 0, 256);
+
+    SFX_GroupRefresh(group, 0);
+
+    return 0;
+}
+
+int UMOD_SFX_GroupSetPanning(int group, int panning)
+{
+    if ((group < 0) || (group >= UMOD_SFX_GROUPS))
+        return -1;
+
+    sfx_group[group].panning = SFX_Clamp(panning, 0, 255);
+
+    SFX_GroupRefresh(group, 0);
+
+    return 0;
+}
+
+int UMOD_SFX_GroupSetBus(int group, int bus)
+{
+    if ((group < 0) || (group >= UMOD_SFX_GROUPS))
+        return -1;
+
+    if ((bus < 0) || (bus >= UMOD_BUSES))
+        return -1;
+
+    sfx_group[group].bus = bus;
+
+    SFX_GroupRefresh(group, 0);
+
+    return 0;
+}
+
+int UMOD_SFX_GroupSetFrequencyMultiplier(int group, uint32_t multiplier)
+{
+    if ((group < 0) || (group >= UMOD_SFX_GROUPS))
+        return -1;
+
+    if (multiplier == 0)
+        return -1;
+
+    sfx_group[group].multiplier = multiplier;
+
+    SFX_GroupRefresh(group, 1);
+
+    return 0;
 }
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#ifndef UMOD_SOUND_EFFECT_H__
+#define UMOD_SOUND_EFFECT_H__
+
+// Resets the state of all SFX channels. Only the channels reserved for SFX are
+// made available, any song channel that was yielded needs to be added again.
+void SFX_Init(void);
+
+// Make a mixer channel available for the SFX player, or take it back. When a
+// channel is taken back, the SFX being played in it is stopped.
+void SFX_ChannelAdd(int channel);
+void SFX_ChannelRemove(int channel);
+
+#endif // UMOD_SOUND_EFFECT_H__
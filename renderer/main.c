@@ -2,8 +2,21 @@
 //
 // Copyright (c) 2021 Antonio Niño Díaz
 
+#if defined(__unix__) || defined(__APPLE__)
+// Needed for MAP_ANONYMOUS
+# define _DEFAULT_SOURCE
+# define RENDERER_PARALLEL
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef RENDERER_PARALLEL
+# include <sys/mman.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
 
 #include <umod/umod.h>
 
@@ -12,66 +25,431 @@
 
 #define SAMPLE_RATE (32 * 1024)
 
-int main(int argc, char *argv[])
-{
-    if (argc != 3)
-    {
-        printf("Invalid number of arguments\n");
-        return -1;
-    }
+// The song is rendered in chunks of 1/60 seconds
+#define CHUNK_SIZE (SAMPLE_RATE / 60)
 
-    // Load file
+#define MAX_CHUNKS (60 * 60 * 10) // 10 minutes limit
 
-    void *pack_buffer = NULL;
-    size_t pack_size;
+// Limits of parallel renders. Each segment is at least one second long, so
+// that the time spent creating processes and replaying the song up to each
+// keyframe doesn't dominate.
+#define MAX_JOBS            64
+#define MIN_SEGMENT_CHUNKS  60
 
-    file_load(argv[1], &pack_buffer, &pack_size);
-    if (pack_size == 0)
-        goto cleanup;
+static void *pack_buffer = NULL;
+
+static wav_writer *output;
+static wav_format output_format = WAV_FORMAT_WAV;
 
-    // Play music until the song ends, while saving it to a WAV
+// Writers of the stems of the song channels. They are NULL if stems aren't
+// saved.
+static wav_writer *stem_writer[UMOD_SONG_CHANNELS];
 
+// Loads the pack and starts the song from the beginning. It returns 0 on
+// success.
+static int song_start(void)
+{
     UMOD_Init(SAMPLE_RATE);
 
     int ret = UMOD_LoadPack(pack_buffer);
     if (ret != 0)
     {
-        printf("UMOD_LoadPack() failed\n");
-        goto cleanup;
+        fprintf(stderr, "UMOD_LoadPack() failed\n");
+        return -1;
     }
 
     UMOD_Song_Play(0);
 
-    WAV_FileStart(argv[2], SAMPLE_RATE);
-    if (!WAV_FileIsOpen())
-        goto cleanup;
+    return 0;
+}
+
+// Converts one chunk to the format of the WAV file
+static void convert_chunk(uint8_t *buffer, const int8_t *left,
+                          const int8_t *right)
+{
+    for (int i = 0; i < CHUNK_SIZE; i++)
+    {
+        buffer[i * 2 + 0] = left[i] + 128;
+        buffer[i * 2 + 1] = right[i] + 128;
+    }
+}
+
+// Mixes one chunk and converts it to the format of the WAV file
+static void render_chunk(uint8_t *buffer)
+{
+    int8_t left[CHUNK_SIZE], right[CHUNK_SIZE];
+    UMOD_Mix(&left[0], &right[0], CHUNK_SIZE);
+
+    convert_chunk(buffer, left, right);
+}
+
+// Mixes one chunk and the stems of the song channels, and sends the stems to
+// their writers.
+static int render_chunk_stems(uint8_t *buffer)
+{
+    int8_t left[CHUNK_SIZE], right[CHUNK_SIZE];
+    static int8_t stem_left[UMOD_SONG_CHANNELS][CHUNK_SIZE];
+    static int8_t stem_right[UMOD_SONG_CHANNELS][CHUNK_SIZE];
+
+    int8_t *stems_left[UMOD_STEMS] = { NULL };
+    int8_t *stems_right[UMOD_STEMS] = { NULL };
+
+    for (int i = 0; i < UMOD_SONG_CHANNELS; i++)
+    {
+        stems_left[i] = &stem_left[i][0];
+        stems_right[i] = &stem_right[i][0];
+    }
+
+    if (UMOD_MixStems(&left[0], &right[0], stems_left, stems_right,
+                      CHUNK_SIZE) != 0)
+        return -1;
+
+    convert_chunk(buffer, left, right);
+
+    for (int i = 0; i < UMOD_SONG_CHANNELS; i++)
+    {
+        uint8_t stem[CHUNK_SIZE * 2];
+        convert_chunk(stem, stem_left[i], stem_right[i]);
+
+        if (WAV_WriterStream(stem_writer[i], stem, sizeof(stem)) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// Play music until the song ends, while saving it to the output. If stems are
+// requested, they are saved at the same time.
+static int render_serial(int stems)
+{
+    if (song_start() != 0)
+        return -1;
+
+    int chunks = 0;
+
+    while (UMOD_Song_IsPlaying())
+    {
+        uint8_t buffer[CHUNK_SIZE * 2];
+
+        if (stems)
+        {
+            if (render_chunk_stems(buffer) != 0)
+            {
+                fprintf(stderr, "Can't save stems\n");
+                return -1;
+            }
+        }
+        else
+        {
+            render_chunk(buffer);
+        }
+
+        if (WAV_WriterStream(output, buffer, sizeof(buffer)) != 0)
+        {
+            fprintf(stderr, "Can't save output\n");
+            return -1;
+        }
+
+        chunks++;
+
+        if (chunks > MAX_CHUNKS)
+            break;
+    }
+
+    return 0;
+}
+
+// Opens one writer for each stem. The name of the files is the name of the
+// output file with the number of the channel appended to it.
+static int open_stems(const char *path)
+{
+    const char *ext = (output_format == WAV_FORMAT_RAW) ? ".raw" : ".wav";
 
-    int frames = 0;
+    size_t len = strlen(path);
+    if ((len > 4) && (strcmp(&path[len - 4], ext) == 0))
+        len -= 4;
+
+    size_t stem_path_size = len + sizeof("_ch00.wav");
+    char *stem_path = malloc(stem_path_size);
+    if (stem_path == NULL)
+        return -1;
+
+    int rc = -1;
+
+    for (int i = 0; i < UMOD_SONG_CHANNELS; i++)
+    {
+        snprintf(stem_path, stem_path_size, "%.*s_ch%d%s", (int)len, path,
+                 i, ext);
+
+        stem_writer[i] = WAV_WriterOpen(stem_path, SAMPLE_RATE, output_format);
+        if (stem_writer[i] == NULL)
+            goto cleanup;
+    }
+
+    rc = 0;
+cleanup:
+    free(stem_path);
+    return rc;
+}
+
+#ifdef RENDERER_PARALLEL
+
+// Render the song in several processes at the same time. The player has a
+// single global state, so each segment of the song is mixed in a child process
+// that inherits the state of the player at the start of the segment.
+//
+// First, the song is played without mixing any audio to find its length. Then,
+// it is played again without mixing audio, and a child process is created at
+// the start of each segment (a keyframe). The child mixes the segment into a
+// buffer shared by all processes while the parent moves on to the next
+// keyframe. UMOD_Skip() leaves the player in the same state as UMOD_Mix(), so
+// the output is exactly the same as when the song is rendered serially.
+static int render_parallel(int jobs)
+{
+    int rc = -1;
+
+    // Find the number of chunks that render_serial() would render
+
+    if (song_start() != 0)
+        return -1;
+
+    size_t chunks = 0;
 
     while (UMOD_Song_IsPlaying())
     {
-#define SIZE (SAMPLE_RATE / 60)
-        int8_t left[SIZE], right[SIZE];
-        UMOD_Mix(&left[0], &right[0], SIZE);
+        UMOD_Skip(CHUNK_SIZE);
+
+        chunks++;
+
+        if (chunks > MAX_CHUNKS)
+            break;
+    }
+
+    if (chunks == 0)
+        return 0;
+
+    size_t size = chunks * CHUNK_SIZE * 2;
+
+    uint8_t *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+    {
+        fprintf(stderr, "Can't allocate output buffer\n");
+        return -1;
+    }
+
+    // Start a child process at each keyframe
 
-        uint8_t buffer[SIZE * 2];
-        for (int i = 0; i < SIZE; i++)
+    if (song_start() != 0)
+        goto cleanup;
+
+    if ((size_t)jobs > chunks / MIN_SEGMENT_CHUNKS)
+        jobs = chunks / MIN_SEGMENT_CHUNKS;
+    if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
+    if (jobs < 1)
+        jobs = 1;
+
+    size_t chunks_per_segment = (chunks + jobs - 1) / jobs;
+
+    int children = 0;
+    int failed = 0;
+
+    for (size_t start = 0; start < chunks; start += chunks_per_segment)
+    {
+        size_t count = chunks - start;
+        if (count > chunks_per_segment)
+            count = chunks_per_segment;
+
+        // Make sure that nothing is printed twice
+        fflush(stdout);
+        fflush(stderr);
+
+        pid_t pid = fork();
+        if (pid == -1)
         {
-            buffer[i * 2 + 0] = left[i] + 128;
-            buffer[i * 2 + 1] = right[i] + 128;
+            fprintf(stderr, "Can't create process\n");
+            failed = 1;
+            break;
         }
 
-        WAV_FileStream(buffer, sizeof(buffer));
+        if (pid == 0)
+        {
+            for (size_t i = 0; i < count; i++)
+                render_chunk(&buffer[(start + i) * CHUNK_SIZE * 2]);
+
+            _exit(0);
+        }
 
-        frames++;
+        children++;
 
-        if (frames > 60 * 60 * 10) // 10 minutes limit
+        for (size_t i = 0; i < count; i++)
+            UMOD_Skip(CHUNK_SIZE);
+    }
+
+    // Wait for all segments to be rendered
+
+    while (children > 0)
+    {
+        int status;
+        if (wait(&status) == -1)
             break;
+
+        if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+            failed = 1;
+
+        children--;
+    }
+
+    if (failed || (children > 0))
+    {
+        fprintf(stderr, "Failed to render segments\n");
+        goto cleanup;
+    }
+
+    if (WAV_WriterStream(output, buffer, size) != 0)
+    {
+        fprintf(stderr, "Can't save output\n");
+        goto cleanup;
+    }
+
+    rc = 0;
+cleanup:
+    munmap(buffer, size);
+    return rc;
+}
+
+#endif // RENDERER_PARALLEL
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+    int jobs = 1;
+    int stems = 0;
+
+    while ((argc > 1) && (strncmp(argv[1], "--", 2) == 0))
+    {
+        if ((strcmp(argv[1], "--jobs") == 0) && (argc > 2))
+        {
+            jobs = atoi(argv[2]);
+            if (jobs < 1)
+            {
+                fprintf(stderr, "Invalid number of jobs: %s\n", argv[2]);
+                return -1;
+            }
+
+            argc--; // Skip value
+            argv++;
+        }
+        else if (strcmp(argv[1], "--stems") == 0)
+        {
+            stems = 1;
+        }
+        else if (strcmp(argv[1], "--raw") == 0)
+        {
+            output_format = WAV_FORMAT_RAW;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[1]);
+            return -1;
+        }
+
+        argc--; // Skip option
+        argv++;
+    }
+
+    if (stems && (jobs > 1))
+    {
+        fprintf(stderr, "--stems can't be used with --jobs\n");
+        return -1;
+    }
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Invalid number of arguments\n\n");
+
+        fprintf(stderr,
+                "Usage: %s [options] [input pack].bin [output file].wav\n\n",
+                argv[0]);
+
+        fprintf(stderr,
+                "Options:\n"
+                "\n"
+                "  --jobs N: Render the song in N segments at the same time.\n"
+                "            The output is the same as with 1 job. Segments\n"
+                "            are at least 1 second long, and N is limited\n"
+                "            to 64.\n"
+                "  --stems:  Also save each song channel to its own file:\n"
+                "            [output file]_ch0.wav, [output file]_ch1.wav...\n"
+                "  --raw:    Save raw 8-bit unsigned stereo PCM data instead\n"
+                "            of WAV files.\n"
+                "\n"
+                "If the output file is '-', the raw data is written to\n"
+                "stdout.\n"
+                "\n");
+        return -1;
+    }
+
+    const char *output_path = argv[2];
+
+    if (strcmp(output_path, "-") == 0)
+    {
+        if (stems)
+        {
+            fprintf(stderr, "--stems can't be used when writing to stdout\n");
+            return -1;
+        }
+
+        output_format = WAV_FORMAT_RAW;
     }
 
-    WAV_FileEnd();
+    // Load file
+
+    size_t pack_size;
+
+    file_load(argv[1], &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    output = WAV_WriterOpen(output_path, SAMPLE_RATE, output_format);
+    if (output == NULL)
+        goto cleanup;
+
+    if (stems)
+    {
+        if (open_stems(output_path) != 0)
+            goto cleanup;
+    }
+
+#ifdef RENDERER_PARALLEL
+    if (jobs > 1)
+        rc = render_parallel(jobs);
+    else
+        rc = render_serial(stems);
+#else
+    if (jobs > 1)
+        fprintf(stderr, "Parallel rendering isn't supported, using 1 job\n");
+
+    rc = render_serial(stems);
+#endif
 
 cleanup:
+    for (int i = 0; i < UMOD_SONG_CHANNELS; i++)
+    {
+        if (stem_writer[i] == NULL)
+            continue;
+
+        if (WAV_WriterClose(stem_writer[i]) != 0)
+            rc = -1;
+    }
+
+    if (output != NULL)
+    {
+        if (WAV_WriterClose(output) != 0)
+            rc = -1;
+    }
+
     free(pack_buffer);
-    return 0;
+    return rc;
 }
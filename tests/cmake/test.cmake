@@ -15,23 +15,103 @@ function(test_mod_wav mod_name)
     set(REF_HEADER "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_header.h")
     set(GEN_WAV "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_generated.wav")
 
+    # All the tests of this song compare their output with the same reference
+    # file, in the same directory. It is extracted only once, before any of the
+    # tests run, so that tests running in parallel don't extract it at the same
+    # time as another test is reading it.
+
+    set(REF_FIXTURE "${base_name}_mod_reference")
+
+    add_test(NAME ${REF_FIXTURE}
+        COMMAND ${CMAKE_COMMAND} -E tar -xf ${REF_TAR_BZ}
+        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    )
+
+    set_tests_properties(${REF_FIXTURE} PROPERTIES FIXTURES_SETUP ${REF_FIXTURE})
+
     # Add test to CTest
 
-    set(CMD1 "${CMAKE_COMMAND} -E tar -xf ${REF_TAR_BZ}")
-    set(CMD2 "$<TARGET_FILE:umod_packer> ${REF_PACK} ${REF_HEADER} ${REF_MOD}")
-    set(CMD3 "$<TARGET_FILE:umod_renderer>  ${REF_PACK} ${GEN_WAV}")
-    set(CMD4 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${GEN_WAV}")
+    set(CMD1 "$<TARGET_FILE:umod_packer> ${REF_PACK} ${REF_HEADER} ${REF_MOD}")
+    set(CMD2 "$<TARGET_FILE:umod_renderer>  ${REF_PACK} ${GEN_WAV}")
+    set(CMD3 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${GEN_WAV}")
 
     add_test(NAME ${base_name}_mod_test
         COMMAND ${CMAKE_COMMAND}
                     -DCMD1=${CMD1}
                     -DCMD2=${CMD2}
                     -DCMD3=${CMD3}
-                    -DCMD4=${CMD4}
                     -P ${CMAKE_SOURCE_DIR}/tests/cmake/runcommands.cmake
         WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
     )
 
+    set_tests_properties(${base_name}_mod_test PROPERTIES FIXTURES_REQUIRED ${REF_FIXTURE})
+
+    # Add test of the compiled version of the song, which must generate the
+    # same output as the original version.
+
+    set(COMPILED_PACK "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_compiled_pack.bin")
+    set(COMPILED_HEADER "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_compiled_header.h")
+    set(COMPILED_WAV "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_compiled.wav")
+
+    set(CMD1 "$<TARGET_FILE:umod_packer> --compile-songs ${COMPILED_PACK} ${COMPILED_HEADER} ${REF_MOD}")
+    set(CMD2 "$<TARGET_FILE:umod_renderer>  ${COMPILED_PACK} ${COMPILED_WAV}")
+    set(CMD3 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${COMPILED_WAV}")
+
+    add_test(NAME ${base_name}_compiled_mod_test
+        COMMAND ${CMAKE_COMMAND}
+                    -DCMD1=${CMD1}
+                    -DCMD2=${CMD2}
+                    -DCMD3=${CMD3}
+                    -P ${CMAKE_SOURCE_DIR}/tests/cmake/runcommands.cmake
+        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    )
+
+    set_tests_properties(${base_name}_compiled_mod_test PROPERTIES FIXTURES_REQUIRED ${REF_FIXTURE})
+
+    # Add test of the song rendered in parallel, which must generate the same
+    # output as the serial render.
+
+    set(PARALLEL_PACK "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_parallel_pack.bin")
+    set(PARALLEL_HEADER "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_parallel_header.h")
+    set(PARALLEL_WAV "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_parallel.wav")
+
+    set(CMD1 "$<TARGET_FILE:umod_packer> ${PARALLEL_PACK} ${PARALLEL_HEADER} ${REF_MOD}")
+    set(CMD2 "$<TARGET_FILE:umod_renderer> --jobs 4 ${PARALLEL_PACK} ${PARALLEL_WAV}")
+    set(CMD3 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${PARALLEL_WAV}")
+
+    add_test(NAME ${base_name}_parallel_mod_test
+        COMMAND ${CMAKE_COMMAND}
+                    -DCMD1=${CMD1}
+                    -DCMD2=${CMD2}
+                    -DCMD3=${CMD3}
+                    -P ${CMAKE_SOURCE_DIR}/tests/cmake/runcommands.cmake
+        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    )
+
+    set_tests_properties(${base_name}_parallel_mod_test PROPERTIES FIXTURES_REQUIRED ${REF_FIXTURE})
+
+    # Add test of the song rendered with the other mixer, which must generate
+    # the same output.
+
+    set(MIXER_PACK "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_${UMOD_TEST_MIXER}_pack.bin")
+    set(MIXER_HEADER "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_${UMOD_TEST_MIXER}_header.h")
+    set(MIXER_WAV "${CMAKE_CURRENT_BINARY_DIR}/${base_name}_${UMOD_TEST_MIXER}.wav")
+
+    set(CMD1 "$<TARGET_FILE:umod_packer> ${MIXER_PACK} ${MIXER_HEADER} ${REF_MOD}")
+    set(CMD2 "$<TARGET_FILE:${UMOD_TEST_RENDERER}> ${MIXER_PACK} ${MIXER_WAV}")
+    set(CMD3 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${MIXER_WAV}")
+
+    add_test(NAME ${base_name}_${UMOD_TEST_MIXER}_mod_test
+        COMMAND ${CMAKE_COMMAND}
+                    -DCMD1=${CMD1}
+                    -DCMD2=${CMD2}
+                    -DCMD3=${CMD3}
+                    -P ${CMAKE_SOURCE_DIR}/tests/cmake/runcommands.cmake
+        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    )
+
+    set_tests_properties(${base_name}_${UMOD_TEST_MIXER}_mod_test PROPERTIES FIXTURES_REQUIRED ${REF_FIXTURE})
+
     # Add target to autogenerate the new compressed file to be used as reference
 
     set(CMD1 "$<TARGET_FILE:umod_packer> ${REF_PACK} ${REF_HEADER} ${REF_MOD}")
@@ -52,13 +132,18 @@ function(test_mod_wav mod_name)
 endfunction()
 
 
+# Any arguments are passed to the packer as options. Audio files generated at
+# build time can be added to the pack after GENERATED_AUDIO.
 function(test_sfx_wav)
 
+    cmake_parse_arguments(TEST "" "" "GENERATED_AUDIO" ${ARGN})
+
     # Generate file names
 
     get_filename_component(directory_name ${CMAKE_CURRENT_SOURCE_DIR} NAME_WE)
 
     set(BINARY_NAME "test_sfx_${directory_name}")
+    set(MIXER_BINARY_NAME "${BINARY_NAME}_${UMOD_TEST_MIXER}")
 
     set(REF_TAR_BZ "${CMAKE_CURRENT_SOURCE_DIR}/reference.wav.tar.bz")
 
@@ -66,27 +151,33 @@ function(test_sfx_wav)
     set(REF_PACK "${CMAKE_CURRENT_BINARY_DIR}/pack.bin")
     set(REF_HEADER "${CMAKE_CURRENT_BINARY_DIR}/pack_header.h")
     set(GEN_WAV "${CMAKE_CURRENT_BINARY_DIR}/generated.wav")
+    set(MIXER_WAV "${CMAKE_CURRENT_BINARY_DIR}/generated_${UMOD_TEST_MIXER}.wav")
 
-    # Build source files
-
-    add_executable(${BINARY_NAME})
-    umod_compiler_flags_sdl2(${BINARY_NAME})
-    umod_linker_flags_sdl2(${BINARY_NAME})
+    # Build source files. The test is built with the player and with the copy of
+    # the player that uses the other mixer.
 
     umod_search_source_files(. FILES_SOURCE)
 
-    target_sources(${BINARY_NAME} PRIVATE ${FILES_SOURCE})
+    foreach(binary ${BINARY_NAME} ${MIXER_BINARY_NAME})
+        add_executable(${binary})
+        umod_compiler_flags_sdl2(${binary})
+        umod_linker_flags_sdl2(${binary})
+
+        target_sources(${binary} PRIVATE ${FILES_SOURCE})
+    endforeach()
 
-    target_link_libraries(${BINARY_NAME} umod_player utils)
+    target_link_libraries(${BINARY_NAME} utils umod_player)
+    target_link_libraries(${MIXER_BINARY_NAME} utils ${UMOD_TEST_PLAYER})
 
     # Create pack file
 
     search_audio_files(. FILES_AUDIO)
+    list(APPEND FILES_AUDIO ${TEST_GENERATED_AUDIO})
 
     add_custom_command(
         OUTPUT ${REF_PACK} ${REF_HEADER}
-        COMMAND $<TARGET_FILE:umod_packer> ${REF_PACK} ${REF_HEADER} ${FILES_AUDIO}
-        DEPENDS ${FILES_AUDIO}
+        COMMAND $<TARGET_FILE:umod_packer> ${TEST_UNPARSED_ARGUMENTS} ${REF_PACK} ${REF_HEADER} ${FILES_AUDIO}
+        DEPENDS ${FILES_AUDIO} umod_packer
         WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
     )
 
@@ -94,25 +185,57 @@ function(test_sfx_wav)
 
     message(VERBOSE "${directory_name}: Adding ${FILES_AUDIO}")
 
-    target_sources(${BINARY_NAME} PRIVATE ${REF_HEADER})
-    target_include_directories(${BINARY_NAME} PRIVATE ${CMAKE_CURRENT_BINARY_DIR})
+    foreach(binary ${BINARY_NAME} ${MIXER_BINARY_NAME})
+        target_sources(${binary} PRIVATE ${REF_HEADER})
+        target_include_directories(${binary} PRIVATE ${CMAKE_CURRENT_BINARY_DIR})
+    endforeach()
     set_source_files_properties(${REF_PACK} ${REF_HEADER} PROPERTIES GENERATED 1)
 
-    # Add test to CTest
+    # Both targets depend on the pack. Make sure that it is only generated once
+    # in parallel builds.
 
-    set(CMD1 "${CMAKE_COMMAND} -E tar -xf ${REF_TAR_BZ}")
-    set(CMD2 "$<TARGET_FILE:${BINARY_NAME}> ${GEN_WAV}")
-    set(CMD3 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${GEN_WAV}")
+    add_dependencies(${MIXER_BINARY_NAME} ${BINARY_NAME})
+
+    # The reference file is extracted once before the tests of both mixers run,
+    # so that they don't extract it while the other one is reading it.
+
+    set(REF_FIXTURE "${directory_name}_sfx_reference")
+
+    add_test(NAME ${REF_FIXTURE}
+        COMMAND ${CMAKE_COMMAND} -E tar -xf ${REF_TAR_BZ}
+        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    )
+
+    set_tests_properties(${REF_FIXTURE} PROPERTIES FIXTURES_SETUP ${REF_FIXTURE})
+
+    # Add tests to CTest
+
+    set(CMD1 "$<TARGET_FILE:${BINARY_NAME}> ${GEN_WAV}")
+    set(CMD2 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${GEN_WAV}")
 
     add_test(NAME ${directory_name}_sfx_test
         COMMAND ${CMAKE_COMMAND}
                     -DCMD1=${CMD1}
                     -DCMD2=${CMD2}
-                    -DCMD3=${CMD3}
                     -P ${CMAKE_SOURCE_DIR}/tests/cmake/runcommands.cmake
         WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
     )
 
+    set_tests_properties(${directory_name}_sfx_test PROPERTIES FIXTURES_REQUIRED ${REF_FIXTURE})
+
+    set(CMD1 "$<TARGET_FILE:${MIXER_BINARY_NAME}> ${MIXER_WAV}")
+    set(CMD2 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} ${MIXER_WAV}")
+
+    add_test(NAME ${directory_name}_${UMOD_TEST_MIXER}_sfx_test
+        COMMAND ${CMAKE_COMMAND}
+                    -DCMD1=${CMD1}
+                    -DCMD2=${CMD2}
+                    -P ${CMAKE_SOURCE_DIR}/tests/cmake/runcommands.cmake
+        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    )
+
+    set_tests_properties(${directory_name}_${UMOD_TEST_MIXER}_sfx_test PROPERTIES FIXTURES_REQUIRED ${REF_FIXTURE})
+
     # Add target to autogenerate the new compressed file to be used as reference
 
     set(CMD1 "$<TARGET_FILE:${BINARY_NAME}> ${REF_WAV}")
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test SFX with 16-bit samples, on their own and mixed with 8-bit SFX, in
+// stereo and mono output modes. The 16-bit WAV file has a loop that isn't at
+// the end of the waveform.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms, int mono)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], mono ? NULL : &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = (mono ? left[i] : right[i]) + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // 16-bit SFX on its own
+
+    umod_handle tone = UMOD_SFX_Play(SFX_TONE_WAV, UMOD_LOOP_DEFAULT);
+    CHECK(tone != UMOD_HANDLE_INVALID);
+
+    generate_ms(200, 0);
+
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(tone, 3 << 14) == 0);
+    generate_ms(150, 0);
+
+    CHECK(UMOD_SFX_SetPanning(tone, 0) == 0);
+    generate_ms(150, 0);
+
+    CHECK(UMOD_SFX_SetPanning(tone, 200) == 0);
+    generate_ms(150, 0);
+
+    // Mixed with 8-bit SFX. Two of them are centered, like the 16-bit one.
+
+    CHECK(UMOD_SFX_SetPanning(tone, 128) == 0);
+
+    umod_handle sine1 = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(sine1 != UMOD_HANDLE_INVALID);
+
+    umod_handle sine2 = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(sine2 != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(sine2, 3 << 15) == 0);
+
+    generate_ms(200, 0);
+
+    CHECK(UMOD_SFX_SetVolume(tone, 100) == 0);
+    CHECK(UMOD_SFX_SetPanning(sine1, 64) == 0);
+    generate_ms(150, 0);
+
+    // Mono output
+
+    UMOD_InitOutput(SAMPLE_RATE, UMOD_OUTPUT_MONO);
+
+    tone = UMOD_SFX_Play(SFX_TONE_WAV, UMOD_LOOP_DEFAULT);
+    CHECK(tone != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetPanning(tone, 64) == 0);
+
+    generate_ms(150, 1);
+
+    sine1 = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(sine1 != UMOD_HANDLE_INVALID);
+
+    generate_ms(150, 1);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test routing of SFX groups to buses and bus volumes.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+// Plays both SFX centered, the laser in the specified group, and mixes the
+// start of the result into the specified buffers.
+#define PAIR_FRAMES (SAMPLE_RATE / 4)
+
+int play_pair(int group, int8_t *left, int8_t *right)
+{
+    UMOD_SFX_StopAll();
+
+    umod_handle ambience = UMOD_SFX_Play(SFX_HELICOPTER_WAV, UMOD_LOOP_ENABLE);
+    if (ambience == UMOD_HANDLE_INVALID)
+        return -1;
+
+    umod_handle laser = UMOD_SFX_PlayGroup(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE,
+                                           UMOD_SFX_PRIORITY_DEFAULT, group);
+    if (laser == UMOD_HANDLE_INVALID)
+        return -1;
+
+    UMOD_Mix(left, right, PAIR_FRAMES);
+
+    return 0;
+}
+
+void generate_ms(int ms)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = right[i] + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // Invalid buses
+
+    CHECK(UMOD_Bus_SetVolume(-1, 128) != 0);
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUSES, 128) != 0);
+    CHECK(UMOD_SFX_GroupSetBus(0, UMOD_BUSES) != 0);
+    CHECK(UMOD_SFX_GroupSetBus(UMOD_SFX_GROUPS, UMOD_BUS_UI) != 0);
+
+    // One loop in the SFX bus and one in the UI bus
+
+    CHECK(UMOD_SFX_GroupSetBus(1, UMOD_BUS_UI) == 0);
+
+    umod_handle ambience = UMOD_SFX_Play(SFX_HELICOPTER_WAV, UMOD_LOOP_ENABLE);
+    CHECK(ambience != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetPanning(ambience, 0) == 0);
+
+    umod_handle ui = UMOD_SFX_PlayGroup(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE,
+                                        UMOD_SFX_PRIORITY_DEFAULT, 1);
+    CHECK(ui != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetPanning(ui, 255) == 0);
+
+    generate_ms(500);
+
+    // The SFX master volume only affects the SFX bus
+
+    UMOD_SFX_SetMasterVolume(64);
+    generate_ms(500);
+
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUS_UI, 128) == 0);
+    generate_ms(500);
+
+    // The music bus doesn't affect SFX
+
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUS_MUSIC, 0) == 0);
+    generate_ms(500);
+
+    // Move the UI SFX to the voice bus
+
+    CHECK(UMOD_SFX_GroupSetBus(1, UMOD_BUS_VOICE) == 0);
+    generate_ms(500);
+
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUS_VOICE, 0) == 0);
+    generate_ms(500);
+
+    // Two centered SFX in different buses are added with full precision, so
+    // the result is the same as if they were in the same bus.
+
+    static int8_t one_left[PAIR_FRAMES], one_right[PAIR_FRAMES];
+    static int8_t two_left[PAIR_FRAMES], two_right[PAIR_FRAMES];
+
+    UMOD_SFX_SetMasterVolume(256);
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUS_VOICE, 256) == 0);
+
+    CHECK(play_pair(0, one_left, one_right) == 0);
+    CHECK(play_pair(1, two_left, two_right) == 0);
+
+    CHECK(memcmp(one_left, two_left, sizeof(one_left)) == 0);
+    CHECK(memcmp(one_right, two_right, sizeof(one_right)) == 0);
+
+    // Mix them with different volumes
+
+    CHECK(play_pair(1, two_left, two_right) == 0);
+
+    UMOD_SFX_SetMasterVolume(192);
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUS_VOICE, 96) == 0);
+    generate_ms(500);
+
+    CHECK(UMOD_Bus_SetVolume(UMOD_BUS_VOICE, 200) == 0);
+    generate_ms(500);
+
+    UMOD_SFX_StopAll();
+    generate_ms(100);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test SFX groups and batch updates of SFX.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = right[i] + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // Invalid groups
+
+    CHECK(UMOD_SFX_PlayGroup(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT,
+                             UMOD_SFX_PRIORITY_DEFAULT, -1) == UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_PlayGroup(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT,
+                             UMOD_SFX_PRIORITY_DEFAULT,
+                             UMOD_SFX_GROUPS) == UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_GroupSetVolume(UMOD_SFX_GROUPS, 128) != 0);
+    CHECK(UMOD_SFX_GroupSetFrequencyMultiplier(0, 0) != 0);
+
+    // Two loops in different groups
+
+    umod_handle ambience = UMOD_SFX_PlayGroup(SFX_HELICOPTER_WAV,
+                                              UMOD_LOOP_ENABLE,
+                                              UMOD_SFX_PRIORITY_DEFAULT, 1);
+    CHECK(ambience != UMOD_HANDLE_INVALID);
+
+    umod_handle ui = UMOD_SFX_PlayGroup(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE,
+                                        UMOD_SFX_PRIORITY_DEFAULT, 2);
+    CHECK(ui != UMOD_HANDLE_INVALID);
+
+    generate_ms(500);
+
+    CHECK(UMOD_SFX_GroupSetVolume(1, 64) == 0);
+    generate_ms(500);
+
+    CHECK(UMOD_SFX_GroupSetPanning(2, 0) == 0);
+    generate_ms(500);
+
+    CHECK(UMOD_SFX_GroupSetFrequencyMultiplier(2, 3 << 15) == 0);
+    generate_ms(500);
+
+    // Effects keep their own values on top of the group values
+
+    CHECK(UMOD_SFX_SetPanning(ui, 255) == 0);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(ui, 1 << 15) == 0);
+    generate_ms(500);
+
+    CHECK(UMOD_SFX_SetGroup(ui, UMOD_SFX_GROUP_DEFAULT) == 0);
+    generate_ms(500);
+
+    // Batch updates
+
+    umod_sfx_update updates[3] = {
+        { ambience, 255, 0, 0 },
+        { ui, -1, -1, 1 << 16 },
+        { UMOD_HANDLE_INVALID, 0, 0, 0 },
+    };
+
+    CHECK(UMOD_SFX_Update(updates, 3) != 0);
+    generate_ms(500);
+
+    CHECK(UMOD_SFX_Stop(ui) == 0);
+
+    updates[0].volume = 128;
+    updates[0].panning = 128;
+    updates[0].frequency_multiplier = 1 << 17;
+
+    CHECK(UMOD_SFX_Update(updates, 1) == 0);
+    CHECK(UMOD_SFX_Update(&updates[1], 1) != 0);
+    generate_ms(500);
+
+    UMOD_SFX_StopAll();
+    generate_ms(100);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -6,8 +6,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <umod/umod.h>
+#include <umod/umodpack.h>
 
 #include "file.h"
 #include "wav_utils.h"
@@ -59,6 +61,29 @@ int main(int argc, char *argv[])
 
     UMOD_Init(SAMPLE_RATE);
 
+    // Try to load packs with a different format
+    // -----------------------------------------
+
+    umodpack_header *header = pack_buffer;
+
+    // Pack generated before the version field existed
+    memcpy(header->magic, "UMOD", sizeof(header->magic));
+    if (UMOD_LoadPack(pack_buffer) == 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+    memcpy(header->magic, UMODPACK_MAGIC, sizeof(header->magic));
+
+    // Pack generated by a different version of the packer
+    header->version = UMODPACK_VERSION + 1;
+    if (UMOD_LoadPack(pack_buffer) == 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+    header->version = UMODPACK_VERSION;
+
     int ret = UMOD_LoadPack(pack_buffer);
     if (ret != 0)
     {
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test SFX played at exactly 1.0, 0.5 and 2.0 times the output sample rate,
+// which use specialized kernels in the voice-major mixer. The frequency is
+// changed while the SFX is being played so that the kernels start with a
+// position that isn't a whole number of samples. The kernels are also tested
+// with SFX that are centered and panned to one side, which are mixed into a
+// single side.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = right[i] + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // The sine wave is sampled at 8303 Hz. Get multipliers that make the final
+    // frequency match the output sample rate exactly.
+
+    const uint32_t rate = 8303;
+
+    const uint32_t unity = (((uint64_t)SAMPLE_RATE << 16) + rate - 1) / rate;
+    const uint32_t half = (((uint64_t)SAMPLE_RATE << 15) + rate - 1) / rate;
+    const uint32_t twice = (((uint64_t)SAMPLE_RATE << 17) + rate - 1) / rate;
+
+    const uint32_t multipliers[] = {
+        unity, 3 << 16, half, 5 << 16, twice, 7 << 16, half, unity, twice,
+    };
+
+    umod_handle sine = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(sine != UMOD_HANDLE_INVALID);
+
+    for (size_t i = 0; i < sizeof(multipliers) / sizeof(multipliers[0]); i++)
+    {
+        CHECK(UMOD_SFX_SetFrequencyMultiplier(sine, multipliers[i]) == 0);
+        generate_ms(103);
+    }
+
+    // One-shot SFX, so that it ends in the middle of a kernel
+
+    CHECK(UMOD_SFX_Stop(sine) == 0);
+
+    sine = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_DISABLE);
+    CHECK(sine != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(sine, half) == 0);
+
+    generate_ms(50);
+    CHECK(UMOD_SFX_IsPlaying(sine) == 0);
+
+    // Two centered SFX are mixed together before splitting them in both sides,
+    // and SFX panned to one side are only mixed in that side.
+
+    const int pannings[][2] = {
+        { 128, 128 }, { 0, 255 }, { 255, 0 },
+    };
+
+    const uint32_t pairs[][2] = {
+        { unity, unity }, { unity, half }, { half, twice }, { twice, unity },
+    };
+
+    umod_handle first = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(first != UMOD_HANDLE_INVALID);
+
+    umod_handle second = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(second != UMOD_HANDLE_INVALID);
+
+    for (size_t p = 0; p < sizeof(pannings) / sizeof(pannings[0]); p++)
+    {
+        CHECK(UMOD_SFX_SetPanning(first, pannings[p][0]) == 0);
+        CHECK(UMOD_SFX_SetPanning(second, pannings[p][1]) == 0);
+
+        for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+        {
+            CHECK(UMOD_SFX_SetFrequencyMultiplier(first, pairs[i][0]) == 0);
+            CHECK(UMOD_SFX_SetFrequencyMultiplier(second, pairs[i][1]) == 0);
+            generate_ms(53);
+        }
+    }
+
+    UMOD_SFX_StopAll();
+    generate_ms(10);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Generates the waveform used by the test: an 8-bit mono WAV file with 1200000
+// samples at 32768 Hz. It is split in 5 sections with triangle waves of
+// different periods, so reading the wrong part of it changes the output.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SAMPLE_RATE         32768
+#define SECTION_SAMPLES     240000
+#define NUM_SECTIONS        5
+#define AMPLITUDE           100
+
+static const int section_period[NUM_SECTIONS] = {
+    1280, 1920, 2560, 3200, 3840
+};
+
+static void write_u16(FILE *f, uint16_t value)
+{
+    fputc(value & 0xFF, f);
+    fputc(value >> 8, f);
+}
+
+static void write_u32(FILE *f, uint32_t value)
+{
+    write_u16(f, value & 0xFFFF);
+    write_u16(f, value >> 16);
+}
+
+// Returns the value of a triangle wave that starts at 0 and goes up first. The
+// period must be a multiple of 4.
+static int triangle(int position, int period)
+{
+    int quarter = period / 4;
+    int phase = position % period;
+
+    if (phase < quarter)
+        return phase * AMPLITUDE / quarter;
+    else if (phase < 3 * quarter)
+        return AMPLITUDE - (phase - quarter) * AMPLITUDE / quarter;
+    else
+        return (phase - 3 * quarter) * AMPLITUDE / quarter - AMPLITUDE;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s [output file].wav\n", argv[0]);
+        return -1;
+    }
+
+    FILE *f = fopen(argv[1], "wb");
+    if (f == NULL)
+    {
+        printf("Can't open file for writing: %s\n", argv[1]);
+        return -1;
+    }
+
+    uint32_t data_size = SECTION_SAMPLES * NUM_SECTIONS;
+
+    fputs("RIFF", f);
+    write_u32(f, 36 + data_size);
+    fputs("WAVE", f);
+
+    fputs("fmt ", f);
+    write_u32(f, 16);           // Size of the chunk
+    write_u16(f, 1);            // PCM
+    write_u16(f, 1);            // Mono
+    write_u32(f, SAMPLE_RATE);  // Sample rate
+    write_u32(f, SAMPLE_RATE);  // Byte rate
+    write_u16(f, 1);            // Block align
+    write_u16(f, 8);            // Bits per sample
+
+    fputs("data", f);
+    write_u32(f, data_size);
+
+    for (int s = 0; s < NUM_SECTIONS; s++)
+    {
+        for (int i = 0; i < SECTION_SAMPLES; i++)
+            fputc(128 + triangle(i, section_period[s]), f);
+    }
+
+    if (fclose(f) != 0)
+    {
+        printf("Failed to write file: %s\n", argv[1]);
+        return -1;
+    }
+
+    return 0;
+}
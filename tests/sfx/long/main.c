@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test a SFX with more than 2^20 samples, which doesn't fit in a 20.12 fixed
+// point position. The waveform is split in sections with triangle waves of
+// different frequencies, so reading the wrong part of it changes the output.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (16 * 1024)
+
+#define MAX_FRAMES SAMPLE_RATE
+
+// Mix the specified number of frames in calls of up to 'frames_per_call'
+void generate_frames(size_t frames, size_t frames_per_call)
+{
+    static int8_t left[MAX_FRAMES], right[MAX_FRAMES];
+    static uint8_t buffer[MAX_FRAMES * 2];
+
+    while (frames > 0)
+    {
+        size_t size = frames_per_call;
+        if (size > frames)
+            size = frames;
+
+        UMOD_Mix(&left[0], &right[0], size);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = right[i] + 128;
+        }
+
+        WAV_FileStream(buffer, size * 2);
+
+        frames -= size;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // The waveform has 1200000 samples at 32768 Hz. Play it 32 times faster so
+    // that the mixer reads 64 samples per frame, and the whole waveform takes
+    // 18750 frames.
+
+    umod_handle sfx = UMOD_SFX_Play(SFX_AMBIENCE_WAV, UMOD_LOOP_DISABLE);
+    CHECK(sfx != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(sfx, 32 << 16) == 0);
+
+    // Mix it in big buffers, so that a single call reads more than 2^19
+    // samples.
+
+    generate_frames(20000, MAX_FRAMES);
+    CHECK(UMOD_SFX_IsPlaying(sfx) == 0);
+
+    // Loop it and mix it in small buffers
+
+    sfx = UMOD_SFX_Play(SFX_AMBIENCE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(sfx != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(sfx, 32 << 16) == 0);
+
+    generate_frames(25000, 256);
+    CHECK(UMOD_SFX_IsPlaying(sfx) == 1);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test ping-pong and backward loops. Each WAV file has a copy in which the part
+// of the loop that is played backwards has been added to the waveform, and the
+// loop has been converted to a forward loop. Both versions must sound exactly
+// the same. The frequency is changed while the SFX are being played so that all
+// the kernels of the mixer are used, and so that the loop is shorter than the
+// distance advanced in a single call to UMOD_Mix().
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+#define MAX_FRAMES (SAMPLE_RATE * 2)
+
+static int8_t left[2][MAX_FRAMES], right[2][MAX_FRAMES];
+
+// Plays a SFX changing its frequency multiplier every 'frames' frames. The
+// output is mixed in calls of different sizes.
+int play(uint32_t index, const uint32_t *multipliers, size_t count,
+         size_t frames, int8_t *out_left, int8_t *out_right)
+{
+    umod_handle sfx = UMOD_SFX_Play(index, UMOD_LOOP_DEFAULT);
+    if (sfx == UMOD_HANDLE_INVALID)
+        return -1;
+
+    size_t call = 1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (UMOD_SFX_SetFrequencyMultiplier(sfx, multipliers[i]) != 0)
+            return -1;
+
+        size_t left_frames = frames;
+
+        while (left_frames > 0)
+        {
+            size_t size = call;
+            if (size > left_frames)
+                size = left_frames;
+
+            UMOD_Mix(out_left, out_right, size);
+
+            out_left += size;
+            out_right += size;
+            left_frames -= size;
+
+            call = (call * 7) % 509;
+        }
+    }
+
+    return UMOD_SFX_Stop(sfx);
+}
+
+void stream(const int8_t *out_left, const int8_t *out_right, size_t frames)
+{
+    static uint8_t buffer[MAX_FRAMES * 2];
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        buffer[i * 2 + 0] = out_left[i] + 128;
+        buffer[i * 2 + 1] = out_right[i] + 128;
+    }
+
+    WAV_FileStream(buffer, frames * 2);
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // The ping-pong WAV file is sampled at 8303 Hz. Get multipliers that make
+    // the final frequency match the output sample rate exactly.
+
+    const uint32_t rate = 8303;
+
+    const uint32_t unity = (((uint64_t)SAMPLE_RATE << 16) + rate - 1) / rate;
+    const uint32_t half = (((uint64_t)SAMPLE_RATE << 15) + rate - 1) / rate;
+    const uint32_t twice = (((uint64_t)SAMPLE_RATE << 17) + rate - 1) / rate;
+
+    // The loops are 1000, 1200 and 1800 frames long. One of the multipliers
+    // makes the SFX advance more than that in a single call.
+
+    const uint32_t multipliers[] = {
+        unity, 3 << 15, half, 5 << 16, twice, 0x1ABCD, unity, 600 << 16, half,
+    };
+    const size_t count = sizeof(multipliers) / sizeof(multipliers[0]);
+    const size_t frames = SAMPLE_RATE / 5;
+    const size_t total = count * frames;
+
+    CHECK(total <= MAX_FRAMES);
+
+    // 8-bit mono ping-pong loop
+
+    CHECK(play(SFX_PINGPONG_WAV, multipliers, count, frames,
+               left[0], right[0]) == 0);
+    CHECK(play(SFX_PINGPONG_BAKED_WAV, multipliers, count, frames,
+               left[1], right[1]) == 0);
+
+    CHECK(memcmp(left[0], left[1], total) == 0);
+    CHECK(memcmp(right[0], right[1], total) == 0);
+
+    stream(left[0], right[0], total);
+
+    // Ping-pong loop that isn't at the end of the waveform. The packer moves the
+    // loop to the end.
+
+    CHECK(play(SFX_TAIL_WAV, multipliers, count, frames,
+               left[0], right[0]) == 0);
+    CHECK(play(SFX_TAIL_BAKED_WAV, multipliers, count, frames,
+               left[1], right[1]) == 0);
+
+    CHECK(memcmp(left[0], left[1], total) == 0);
+    CHECK(memcmp(right[0], right[1], total) == 0);
+
+    stream(left[0], right[0], total);
+
+    // 16-bit stereo backward loop
+
+    CHECK(play(SFX_BACKWARD_WAV, multipliers, count, frames,
+               left[0], right[0]) == 0);
+    CHECK(play(SFX_BACKWARD_BAKED_WAV, multipliers, count, frames,
+               left[1], right[1]) == 0);
+
+    CHECK(memcmp(left[0], left[1], total) == 0);
+    CHECK(memcmp(right[0], right[1], total) == 0);
+
+    stream(left[0], right[0], total);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
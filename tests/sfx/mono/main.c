@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test mono output mode. The right buffer passed to UMOD_Mix() is NULL, and the
+// mono output is saved to both channels of the WAV file.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t mono[SIZE];
+        UMOD_Mix(&mono[0], NULL, SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = mono[i] + 128;
+            buffer[i * 2 + 1] = mono[i] + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_InitOutput(SAMPLE_RATE, UMOD_OUTPUT_MONO);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // Panning only changes the volume of a SFX a bit in mono mode
+
+    umod_handle helicopter = UMOD_SFX_Play(SFX_HELICOPTER_WAV, UMOD_LOOP_ENABLE);
+    CHECK(helicopter != UMOD_HANDLE_INVALID);
+
+    generate_ms(300);
+
+    CHECK(UMOD_SFX_SetPanning(helicopter, 0) == 0);
+    generate_ms(300);
+
+    CHECK(UMOD_SFX_SetPanning(helicopter, 255) == 0);
+    generate_ms(300);
+
+    CHECK(UMOD_SFX_SetVolume(helicopter, 64) == 0);
+    generate_ms(300);
+
+    umod_handle laser = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT);
+    CHECK(laser != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetPanning(laser, 0) == 0);
+
+    generate_ms(600);
+
+    // Silent SFX
+
+    CHECK(UMOD_SFX_SetVolume(helicopter, 0) == 0);
+    generate_ms(300);
+
+    CHECK(UMOD_SFX_SetVolume(helicopter, 255) == 0);
+    generate_ms(300);
+
+    UMOD_SFX_StopAll();
+    generate_ms(100);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
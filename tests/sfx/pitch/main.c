@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test SFX played with very high frequency multipliers, so that the mixer
+// advances many samples per output frame.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = right[i] + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // Looping SFX. The highest multipliers advance more samples per frame than
+    // the size of the loop.
+
+    umod_handle sine = UMOD_SFX_Play(SFX_SINE_WAV, UMOD_LOOP_ENABLE);
+    CHECK(sine != UMOD_HANDLE_INVALID);
+
+    const uint32_t multipliers[] = { 4, 7, 16, 33, 64, 300, 2048 };
+
+    for (size_t i = 0; i < sizeof(multipliers) / sizeof(multipliers[0]); i++)
+    {
+        CHECK(UMOD_SFX_SetFrequencyMultiplier(sine, multipliers[i] << 16) == 0);
+        generate_ms(200);
+        CHECK(UMOD_SFX_IsPlaying(sine));
+    }
+
+    CHECK(UMOD_SFX_Stop(sine) == 0);
+    generate_ms(100);
+
+    // One-shot SFX. It has to end at the right time even if the last frame
+    // jumps over the end of the waveform.
+
+    umod_handle laser = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT);
+    CHECK(laser != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(laser, 13 << 16) == 0);
+
+    generate_ms(60);
+    CHECK(UMOD_SFX_IsPlaying(laser) == 0);
+
+    generate_ms(100);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
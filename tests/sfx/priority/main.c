@@ -0,0 +1,305 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test SFX priorities and song channels yielded to the SFX player.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = right[i] + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    umod_handle helicopter_handle;
+    umod_handle laser_handle[UMOD_SFX_CHANNELS];
+    umod_handle handle;
+
+    // Fill all channels with SFX of the default priority
+    // --------------------------------------------------
+
+    helicopter_handle = UMOD_SFX_Play(SFX_HELICOPTER_WAV, UMOD_LOOP_ENABLE);
+    if (helicopter_handle == UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+    generate_ms(500);
+
+    for (int i = 0; i < UMOD_SFX_CHANNELS - 1; i++)
+    {
+        laser_handle[i] = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT);
+        if (laser_handle[i] == UMOD_HANDLE_INVALID)
+        {
+            printf("Line %d: Check failed (iteration %d)\n", __LINE__, i);
+            goto cleanup;
+        }
+        generate_ms(50);
+    }
+
+    // SFX with the same or lower priority can't stop any other SFX
+
+    handle = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT);
+    if (handle != UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    handle = UMOD_SFX_PlayPriority(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT,
+                                   UMOD_SFX_PRIORITY_LOWEST);
+    if (handle != UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    // A SFX with a higher priority stops the SFX that is closest to its end,
+    // which is the first laser.
+
+    handle = UMOD_SFX_PlayPriority(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT,
+                                   UMOD_SFX_PRIORITY_HIGHEST);
+    if (handle == UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    if ((UMOD_SFX_IsPlaying(laser_handle[0]) != 0) ||
+        (UMOD_SFX_IsPlaying(laser_handle[1]) != 1) ||
+        (UMOD_SFX_IsPlaying(laser_handle[2]) != 1) ||
+        (UMOD_SFX_IsPlaying(helicopter_handle) != 1))
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(50);
+
+    // A quiet SFX is stopped before a loud one, even if it has more time left.
+
+    if (UMOD_SFX_SetVolume(helicopter_handle, 0) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    laser_handle[0] = UMOD_SFX_PlayPriority(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT,
+                                            UMOD_SFX_PRIORITY_DEFAULT + 1);
+    if (laser_handle[0] == UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    if (UMOD_SFX_IsPlaying(helicopter_handle) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(1000);
+
+    UMOD_SFX_StopAll();
+
+    // Song channels yielded to the SFX player
+    // ---------------------------------------
+
+    if (UMOD_Song_YieldChannels(UMOD_SONG_CHANNELS + 1) == 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    if (UMOD_Song_YieldChannels(2) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    for (int i = 0; i < UMOD_SFX_CHANNELS + 2; i++)
+    {
+        handle = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT);
+        if (handle == UMOD_HANDLE_INVALID)
+        {
+            printf("Line %d: Check failed (iteration %d)\n", __LINE__, i);
+            goto cleanup;
+        }
+        generate_ms(50);
+    }
+
+    handle = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_DEFAULT);
+    if (handle != UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    // Taking the channels back stops the SFX played in them
+
+    if (UMOD_Song_YieldChannels(0) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(1000);
+
+    // Song channels yielded while the song is playing
+    // -----------------------------------------------
+
+    if (UMOD_Song_Play(SONG_RANGE_TEST_MOD) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(500);
+
+    // The notes being played in the yielded channels are stopped, but the song
+    // keeps updating them while they are yielded.
+
+    if (UMOD_Song_YieldChannels(UMOD_SONG_CHANNELS) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    handle = UMOD_SFX_Play(SFX_HELICOPTER_WAV, UMOD_LOOP_ENABLE);
+    if (handle == UMOD_HANDLE_INVALID)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(500);
+
+    // The song is heard again from the next note of each channel
+
+    if (UMOD_Song_YieldChannels(0) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(500);
+
+    // Start the song while some channels are yielded and used by SFX. The song
+    // must keep using the yielded channels without stopping the SFX.
+
+    UMOD_SFX_StopAll();
+
+    if (UMOD_Song_YieldChannels(2) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    umod_handle looped[UMOD_SFX_CHANNELS + 2];
+
+    for (int i = 0; i < UMOD_SFX_CHANNELS + 2; i++)
+    {
+        looped[i] = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE);
+        if (looped[i] == UMOD_HANDLE_INVALID)
+        {
+            printf("Line %d: Check failed (iteration %d)\n", __LINE__, i);
+            goto cleanup;
+        }
+    }
+
+    if (UMOD_Song_Play(SONG_RANGE_TEST_MOD) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(250);
+
+    for (int i = 0; i < UMOD_SFX_CHANNELS + 2; i++)
+    {
+        if (UMOD_SFX_IsPlaying(looped[i]) != 1)
+        {
+            printf("Line %d: Check failed (iteration %d)\n", __LINE__, i);
+            goto cleanup;
+        }
+    }
+
+    if (UMOD_Song_YieldChannels(0) != 0)
+    {
+        printf("Line %d: Check failed\n", __LINE__);
+        goto cleanup;
+    }
+
+    generate_ms(500);
+
+    UMOD_Song_Stop();
+    UMOD_SFX_StopAll();
+
+    generate_ms(100);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
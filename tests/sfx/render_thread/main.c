@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test the render thread driver. A song and a SFX are mixed directly with
+// UMOD_Mix(), and then they are mixed again by the render thread and read out
+// of its ring buffer. Both outputs must be exactly the same. The ring buffer
+// isn't a multiple of the block size of the thread or the size of the reads,
+// so the data wraps around its end in the middle of blocks and reads.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <umod/umod.h>
+
+#include "audio_thread.h"
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+#define MAX_FRAMES (SAMPLE_RATE * 2)
+
+#define LOOK_AHEAD  1000
+#define BLOCK_SIZE  300
+#define READ_SIZE   441
+
+static int8_t left[2][MAX_FRAMES], right[2][MAX_FRAMES];
+
+static void wait_ms(long ms)
+{
+    struct timespec ts = { 0, ms * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+static int start_sound(void)
+{
+    if (UMOD_Song_Play(SONG_RANGE_TEST_MOD) != 0)
+        return -1;
+
+    umod_handle sfx = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE);
+    if (sfx == UMOD_HANDLE_INVALID)
+        return -1;
+
+    return UMOD_SFX_SetPanning(sfx, 32);
+}
+
+static void stop_sound(void)
+{
+    UMOD_Song_Stop();
+    UMOD_SFX_StopAll();
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // Mix the reference directly
+
+    CHECK(start_sound() == 0);
+    UMOD_Mix(left[0], right[0], MAX_FRAMES);
+    stop_sound();
+
+    // Mix the same sounds from the render thread. The sounds are started
+    // before the thread so that the first block it mixes is the same as the
+    // start of the reference.
+
+    CHECK(start_sound() == 0);
+    CHECK(AudioThread_Start(SAMPLE_RATE, LOOK_AHEAD, BLOCK_SIZE) == 0);
+
+    size_t frames = 0;
+
+    while (frames < MAX_FRAMES)
+    {
+        size_t size = READ_SIZE;
+        if (size > MAX_FRAMES - frames)
+            size = MAX_FRAMES - frames;
+
+        // Wait until there is enough data so that there are no underruns
+
+        while (AudioThread_Available() < size)
+            wait_ms(1);
+
+        CHECK(AudioThread_Read(&left[1][frames], &right[1][frames], size)
+              == size);
+
+        frames += size;
+    }
+
+    audio_thread_stats stats;
+    CHECK(AudioThread_GetStats(&stats) == 0);
+    CHECK(stats.underruns == 0);
+    CHECK(stats.underrun_frames == 0);
+    CHECK(stats.fill_max <= LOOK_AHEAD);
+    CHECK(stats.reads == (MAX_FRAMES + READ_SIZE - 1) / READ_SIZE);
+
+    // Underruns are filled with silence. Wait until the ring buffer is full so
+    // that the thread can't mix anything else, and read more than that.
+
+    while (AudioThread_Available() < LOOK_AHEAD - BLOCK_SIZE + 1)
+        wait_ms(1);
+
+    size_t available = AudioThread_Available();
+
+    static int8_t extra_left[LOOK_AHEAD * 2], extra_right[LOOK_AHEAD * 2];
+    memset(extra_left, 1, sizeof(extra_left));
+    memset(extra_right, 1, sizeof(extra_right));
+
+    AudioThread_ResetStats();
+    CHECK(AudioThread_Read(extra_left, extra_right, LOOK_AHEAD * 2)
+          == available);
+
+    for (size_t i = available; i < LOOK_AHEAD * 2; i++)
+        CHECK((extra_left[i] == 0) && (extra_right[i] == 0));
+
+    CHECK(AudioThread_GetStats(&stats) == 0);
+    CHECK(stats.reads == 1);
+    CHECK(stats.underruns == 1);
+    CHECK(stats.underrun_frames == LOOK_AHEAD * 2 - available);
+    CHECK(stats.fill_last == available);
+
+    AudioThread_Lock();
+    stop_sound();
+    AudioThread_Unlock();
+
+    AudioThread_Stop();
+
+    // Compare the output of the thread with the reference
+
+    CHECK(memcmp(left[0], left[1], MAX_FRAMES) == 0);
+    CHECK(memcmp(right[0], right[1], MAX_FRAMES) == 0);
+
+    static uint8_t buffer[MAX_FRAMES * 2];
+
+    for (size_t i = 0; i < MAX_FRAMES; i++)
+    {
+        buffer[i * 2 + 0] = left[1][i] + 128;
+        buffer[i * 2 + 1] = right[1][i] + 128;
+    }
+
+    WAV_FileStream(buffer, sizeof(buffer));
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    AudioThread_Stop();
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test playing the same song twice. Effects remember their last parameters, and
+// they must be cleared when a song starts, or the second time the song is
+// played it sounds different than the first time. All the songs of the pack
+// are played twice until they end, and both outputs must be the same.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+#define MAX_FRAMES (SAMPLE_RATE * 30)
+
+#define CHUNK_SIZE (SAMPLE_RATE / 60)
+
+static int8_t left[2][MAX_FRAMES], right[2][MAX_FRAMES];
+
+static const uint32_t songs[] = {
+    SONG_PORTA_TO_NOTE_MOD,
+    SONG_SAMPLE_OFFSET_MOD,
+    SONG_TREMOLO_MOD,
+    SONG_VIBRATO_MOD,
+};
+
+// Plays a song until it ends. It returns the number of frames mixed, or 0 if
+// the song doesn't fit in the buffers.
+static size_t play_song(uint32_t song, int8_t *out_left, int8_t *out_right)
+{
+    if (UMOD_Song_Play(song) != 0)
+        return 0;
+
+    size_t frames = 0;
+
+    while (UMOD_Song_IsPlaying())
+    {
+        if (frames + CHUNK_SIZE > MAX_FRAMES)
+            return 0;
+
+        UMOD_Mix(&out_left[frames], &out_right[frames], CHUNK_SIZE);
+        frames += CHUNK_SIZE;
+    }
+
+    return frames;
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    for (size_t s = 0; s < sizeof(songs) / sizeof(songs[0]); s++)
+    {
+        size_t frames = play_song(songs[s], left[0], right[0]);
+        CHECK(frames > 0);
+
+        // Play the song again right after the first time, without reloading
+        // the pack or initializing the library.
+        CHECK(play_song(songs[s], left[1], right[1]) == frames);
+
+        CHECK(memcmp(left[0], left[1], frames) == 0);
+        CHECK(memcmp(right[0], right[1], frames) == 0);
+
+        static uint8_t buffer[MAX_FRAMES * 2];
+
+        for (size_t i = 0; i < frames; i++)
+        {
+            buffer[i * 2 + 0] = left[1][i] + 128;
+            buffer[i * 2 + 1] = right[1][i] + 128;
+        }
+
+        WAV_FileStream(buffer, frames * 2);
+    }
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test UMOD_MixRing(). A song and a SFX are mixed into linear buffers with
+// UMOD_Mix(), and then they are mixed again into ring buffers with calls of
+// different sizes, so that the end of the ring buffers is reached in the middle
+// of song ticks. The frames are copied out of the ring buffers after every
+// call. Both outputs must be exactly the same, in stereo and mono modes.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+#define MAX_FRAMES (SAMPLE_RATE * 2)
+
+#define RING_SIZE   1000
+
+static int8_t left[2][MAX_FRAMES], right[2][MAX_FRAMES];
+
+static int8_t ring_left[RING_SIZE], ring_right[RING_SIZE];
+
+static int start_sound(void)
+{
+    if (UMOD_Song_Play(SONG_RANGE_TEST_MOD) != 0)
+        return -1;
+
+    umod_handle sfx = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE);
+    if (sfx == UMOD_HANDLE_INVALID)
+        return -1;
+
+    return UMOD_SFX_SetPanning(sfx, 32);
+}
+
+static void stop_sound(void)
+{
+    UMOD_Song_Stop();
+    UMOD_SFX_StopAll();
+}
+
+// Mixes the specified number of frames using the ring buffers, and copies them
+// to the output buffers. In mono mode out_right is NULL.
+static int mix_ring(int8_t *out_left, int8_t *out_right, size_t frames)
+{
+    size_t write_index = 0;
+    size_t call = 1;
+
+    while (frames > 0)
+    {
+        size_t size = call;
+        if (size > frames)
+            size = frames;
+
+        if (UMOD_MixRing(ring_left, (out_right != NULL) ? ring_right : NULL,
+                         RING_SIZE, write_index, size) != 0)
+            return -1;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            size_t index = (write_index + i) % RING_SIZE;
+
+            out_left[i] = ring_left[index];
+            if (out_right != NULL)
+                out_right[i] = ring_right[index];
+        }
+
+        out_left += size;
+        if (out_right != NULL)
+            out_right += size;
+        frames -= size;
+
+        // Let the write index grow past the size of the ring buffer
+        write_index += size;
+
+        call = (call * 7) % RING_SIZE + 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // Invalid arguments
+
+    CHECK(UMOD_MixRing(ring_left, ring_right, 0, 0, 0) != 0);
+    CHECK(UMOD_MixRing(ring_left, ring_right, RING_SIZE, 0, RING_SIZE + 1)
+          != 0);
+
+    // Stereo
+
+    CHECK(start_sound() == 0);
+    UMOD_Mix(left[0], right[0], MAX_FRAMES);
+    stop_sound();
+
+    CHECK(start_sound() == 0);
+    CHECK(mix_ring(left[1], right[1], MAX_FRAMES) == 0);
+    stop_sound();
+
+    CHECK(memcmp(left[0], left[1], MAX_FRAMES) == 0);
+    CHECK(memcmp(right[0], right[1], MAX_FRAMES) == 0);
+
+    static uint8_t buffer[MAX_FRAMES * 2];
+
+    for (size_t i = 0; i < MAX_FRAMES; i++)
+    {
+        buffer[i * 2 + 0] = left[1][i] + 128;
+        buffer[i * 2 + 1] = right[1][i] + 128;
+    }
+
+    WAV_FileStream(buffer, sizeof(buffer));
+
+    // Mono
+
+    UMOD_InitOutput(SAMPLE_RATE, UMOD_OUTPUT_MONO);
+    CHECK(UMOD_LoadPack(pack_buffer) == 0);
+
+    CHECK(start_sound() == 0);
+    UMOD_Mix(left[0], NULL, MAX_FRAMES);
+    stop_sound();
+
+    CHECK(start_sound() == 0);
+    CHECK(mix_ring(left[1], NULL, MAX_FRAMES) == 0);
+    stop_sound();
+
+    CHECK(memcmp(left[0], left[1], MAX_FRAMES) == 0);
+
+    for (size_t i = 0; i < MAX_FRAMES; i++)
+    {
+        buffer[i * 2 + 0] = left[1][i] + 128;
+        buffer[i * 2 + 1] = left[1][i] + 128;
+    }
+
+    WAV_FileStream(buffer, sizeof(buffer));
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
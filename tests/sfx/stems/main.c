@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test UMOD_MixStems(). A song and a SFX are mixed with stems in calls of
+// different sizes. The master mix must be the same as the one generated by
+// UMOD_Mix(), and the stem of the SFX must be the same as the output of
+// UMOD_Mix() when the SFX is played on its own. The master mix and the stems
+// are saved one after the other.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+#define MAX_FRAMES (SAMPLE_RATE / 2)
+
+static int8_t left[MAX_FRAMES], right[MAX_FRAMES];
+static int8_t ref_left[MAX_FRAMES], ref_right[MAX_FRAMES];
+static int8_t stem_left[UMOD_STEMS][MAX_FRAMES];
+static int8_t stem_right[UMOD_STEMS][MAX_FRAMES];
+
+static int8_t *const stems_left[UMOD_STEMS] = {
+    stem_left[0], stem_left[1], stem_left[2], stem_left[3],
+    stem_left[4], stem_left[5], stem_left[6], stem_left[7],
+    stem_left[8], stem_left[9], stem_left[10], stem_left[11],
+};
+
+static int8_t *const stems_right[UMOD_STEMS] = {
+    stem_right[0], stem_right[1], stem_right[2], stem_right[3],
+    stem_right[4], stem_right[5], stem_right[6], stem_right[7],
+    stem_right[8], stem_right[9], stem_right[10], stem_right[11],
+};
+
+static int start_sound(int song)
+{
+    if (song)
+    {
+        if (UMOD_Song_Play(SONG_RANGE_TEST_MOD) != 0)
+            return -1;
+    }
+
+    umod_handle sfx = UMOD_SFX_Play(SFX_LASER2_1_WAV, UMOD_LOOP_ENABLE);
+    if (sfx == UMOD_HANDLE_INVALID)
+        return -1;
+
+    return UMOD_SFX_SetPanning(sfx, 200);
+}
+
+static void stop_sound(void)
+{
+    UMOD_Song_Stop();
+    UMOD_SFX_StopAll();
+}
+
+// Mixes with stems in calls of different sizes. The stem buffers are moved
+// forward after every call.
+static int mix_stems(int8_t *out_left, int8_t *out_right, size_t frames)
+{
+    size_t offset = 0;
+    size_t call = 1;
+
+    while (offset < frames)
+    {
+        size_t size = call;
+        if (size > frames - offset)
+            size = frames - offset;
+
+        int8_t *l[UMOD_STEMS];
+        int8_t *r[UMOD_STEMS];
+
+        for (int i = 0; i < UMOD_STEMS; i++)
+        {
+            l[i] = stems_left[i] + offset;
+            r[i] = stems_right[i] + offset;
+        }
+
+        if (UMOD_MixStems(out_left + offset,
+                          (out_right != NULL) ? out_right + offset : NULL,
+                          l, (out_right != NULL) ? r : NULL, size) != 0)
+            return -1;
+
+        offset += size;
+
+        call = (call * 7) % 1009 + 1;
+    }
+
+    return 0;
+}
+
+static void stream(const int8_t *out_left, const int8_t *out_right)
+{
+    static uint8_t buffer[MAX_FRAMES * 2];
+
+    for (size_t i = 0; i < MAX_FRAMES; i++)
+    {
+        buffer[i * 2 + 0] = out_left[i] + 128;
+        buffer[i * 2 + 1] = out_right[i] + 128;
+    }
+
+    WAV_FileStream(buffer, sizeof(buffer));
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // In stereo mode both sides of every stem are required
+
+    CHECK(UMOD_MixStems(left, right, NULL, NULL, 16) != 0);
+    CHECK(UMOD_MixStems(left, right, stems_left, NULL, 16) != 0);
+
+    // The SFX on its own
+
+    CHECK(start_sound(0) == 0);
+    UMOD_Mix(ref_left, ref_right, MAX_FRAMES);
+    stop_sound();
+
+    // Song and SFX with stems
+
+    CHECK(start_sound(1) == 0);
+    CHECK(mix_stems(left, right, MAX_FRAMES) == 0);
+    stop_sound();
+
+    // The stem of the SFX channel must match the SFX on its own, and the other
+    // SFX stems must be silent.
+
+    int sfx_stems = 0;
+
+    for (int i = UMOD_SONG_CHANNELS; i < UMOD_STEMS; i++)
+    {
+        if ((memcmp(stem_left[i], ref_left, MAX_FRAMES) == 0) &&
+            (memcmp(stem_right[i], ref_right, MAX_FRAMES) == 0))
+        {
+            sfx_stems++;
+            continue;
+        }
+
+        for (size_t f = 0; f < MAX_FRAMES; f++)
+            CHECK((stem_left[i][f] == 0) && (stem_right[i][f] == 0));
+    }
+
+    CHECK(sfx_stems == 1);
+
+    stream(left, right);
+    for (int i = 0; i < UMOD_STEMS; i++)
+        stream(stem_left[i], stem_right[i]);
+
+    // The master mix must be the same as without stems
+
+    CHECK(start_sound(1) == 0);
+    UMOD_Mix(ref_left, ref_right, MAX_FRAMES);
+    stop_sound();
+
+    CHECK(memcmp(left, ref_left, MAX_FRAMES) == 0);
+    CHECK(memcmp(right, ref_right, MAX_FRAMES) == 0);
+
+    // Mono mode doesn't need the right stems
+
+    UMOD_InitOutput(SAMPLE_RATE, UMOD_OUTPUT_MONO);
+
+    CHECK(start_sound(1) == 0);
+    UMOD_Mix(ref_left, NULL, MAX_FRAMES);
+    stop_sound();
+
+    CHECK(start_sound(1) == 0);
+    CHECK(mix_stems(left, NULL, MAX_FRAMES) == 0);
+    stop_sound();
+
+    CHECK(memcmp(left, ref_left, MAX_FRAMES) == 0);
+
+    stream(left, left);
+    for (int i = 0; i < UMOD_STEMS; i++)
+        stream(stem_left[i], stem_left[i]);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Test stereo SFX, both 8-bit and 16-bit, in stereo and mono output modes. Each
+// side of the WAV files has a different waveform, so mixing the wrong side or
+// reading the frames with the wrong stride changes the output. The 16-bit WAV
+// file has a loop that isn't at the end of the waveform.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <umod/umod.h>
+
+#include "check.h"
+#include "file.h"
+#include "wav_utils.h"
+
+#include "pack_header.h"
+
+#define SAMPLE_RATE (32 * 1024)
+
+void generate_ms(int ms, int mono)
+{
+    for (int t = 0; t < ms; t++)
+    {
+#define SIZE (SAMPLE_RATE / 1000)
+
+        int8_t left[SIZE], right[SIZE];
+        UMOD_Mix(&left[0], mono ? NULL : &right[0], SIZE);
+
+        uint8_t buffer[SIZE * 2];
+        for (int i = 0; i < SIZE; i++)
+        {
+            buffer[i * 2 + 0] = left[i] + 128;
+            buffer[i * 2 + 1] = (mono ? left[i] : right[i]) + 128;
+        }
+
+        WAV_FileStream(buffer, sizeof(buffer));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = -1;
+
+    if (argc != 2)
+    {
+        printf("Invalid number of arguments\n");
+        return -1;
+    }
+
+    // Load file
+
+    void *pack_buffer = NULL;
+    size_t pack_size;
+
+    file_load("pack.bin", &pack_buffer, &pack_size);
+    if (pack_size == 0)
+        goto cleanup;
+
+    // Initialize library
+
+    UMOD_Init(SAMPLE_RATE);
+
+    int ret = UMOD_LoadPack(pack_buffer);
+    if (ret != 0)
+    {
+        printf("UMOD_LoadPack() failed\n");
+        goto cleanup;
+    }
+
+    WAV_FileStart(argv[1], SAMPLE_RATE);
+    if (!WAV_FileIsOpen())
+        goto cleanup;
+
+    // 8-bit stereo SFX on its own, with the panning used as balance
+
+    umod_handle voices = UMOD_SFX_Play(SFX_VOICES_WAV, UMOD_LOOP_ENABLE);
+    CHECK(voices != UMOD_HANDLE_INVALID);
+
+    generate_ms(150, 0);
+
+    CHECK(UMOD_SFX_SetPanning(voices, 0) == 0);
+    generate_ms(100, 0);
+
+    CHECK(UMOD_SFX_SetPanning(voices, 255) == 0);
+    generate_ms(100, 0);
+
+    CHECK(UMOD_SFX_SetPanning(voices, 64) == 0);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(voices, 3 << 15) == 0);
+    generate_ms(150, 0);
+
+    // 16-bit stereo SFX mixed with the 8-bit one
+
+    umod_handle engine = UMOD_SFX_Play(SFX_ENGINE_WAV, UMOD_LOOP_DEFAULT);
+    CHECK(engine != UMOD_HANDLE_INVALID);
+
+    generate_ms(200, 0);
+
+    CHECK(UMOD_SFX_SetVolume(engine, 100) == 0);
+    CHECK(UMOD_SFX_SetPanning(engine, 200) == 0);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(engine, 1 << 15) == 0);
+    generate_ms(200, 0);
+
+    CHECK(UMOD_SFX_Stop(voices) == 0);
+    CHECK(UMOD_SFX_SetFrequencyMultiplier(engine, 2 << 16) == 0);
+    generate_ms(150, 0);
+
+    // Mono output
+
+    UMOD_InitOutput(SAMPLE_RATE, UMOD_OUTPUT_MONO);
+
+    engine = UMOD_SFX_Play(SFX_ENGINE_WAV, UMOD_LOOP_DEFAULT);
+    CHECK(engine != UMOD_HANDLE_INVALID);
+    CHECK(UMOD_SFX_SetPanning(engine, 64) == 0);
+
+    generate_ms(150, 1);
+
+    voices = UMOD_SFX_Play(SFX_VOICES_WAV, UMOD_LOOP_ENABLE);
+    CHECK(voices != UMOD_HANDLE_INVALID);
+
+    generate_ms(150, 1);
+
+    WAV_FileEnd();
+
+    rc = 0;
+cleanup:
+    free(pack_buffer);
+    return rc;
+}
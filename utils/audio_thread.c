@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+// Needed for nanosleep()
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <umod/umod.h>
+
+#include "audio_thread.h"
+
+static pthread_t audio_thread;
+static pthread_mutex_t audio_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int audio_running;
+
+// Ring buffer. The indices grow forever, the position in the buffers is the
+// index modulo the capacity. The producer only writes write_index, and the
+// consumer only writes read_index.
+static int8_t *ring_left;
+static int8_t *ring_right;
+static size_t ring_capacity;
+static size_t ring_block_size;
+static atomic_size_t ring_write_index;
+static atomic_size_t ring_read_index;
+
+// Time the render thread sleeps when the ring buffer is full
+static long audio_sleep_ns;
+
+// Statistics. They are only written by the consumer, but they can be read from
+// any thread.
+static atomic_uint_least32_t stats_reads;
+static atomic_uint_least32_t stats_underruns;
+static atomic_uint_least32_t stats_underrun_frames;
+static atomic_uint_least32_t stats_fill_min;
+static atomic_uint_least32_t stats_fill_max;
+static atomic_uint_least32_t stats_fill_last;
+static atomic_uint_least64_t stats_fill_sum;
+
+void AudioThread_Lock(void)
+{
+    pthread_mutex_lock(&audio_lock);
+}
+
+void AudioThread_Unlock(void)
+{
+    pthread_mutex_unlock(&audio_lock);
+}
+
+// Mixes frames into the ring buffer starting at the specified index. The
+// caller must make sure that the frames fit in the free space of the buffer.
+static void AudioThread_Mix(size_t index, size_t frames)
+{
+    AudioThread_Lock();
+
+    UMOD_MixRing(ring_left, ring_right, ring_capacity, index, frames);
+
+    AudioThread_Unlock();
+}
+
+static void *AudioThread_Main(void *arg)
+{
+    (void)arg;
+
+    while (atomic_load_explicit(&audio_running, memory_order_acquire))
+    {
+        size_t write = atomic_load_explicit(&ring_write_index,
+                                            memory_order_relaxed);
+        size_t read = atomic_load_explicit(&ring_read_index,
+                                           memory_order_acquire);
+
+        size_t free_frames = ring_capacity - (write - read);
+
+        if (free_frames < ring_block_size)
+        {
+            struct timespec ts = { 0, audio_sleep_ns };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        AudioThread_Mix(write, ring_block_size);
+
+        // Publish the new frames after they have been written
+        atomic_store_explicit(&ring_write_index, write + ring_block_size,
+                              memory_order_release);
+    }
+
+    return NULL;
+}
+
+void AudioThread_ResetStats(void)
+{
+    atomic_store_explicit(&stats_reads, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_underruns, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_underrun_frames, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_fill_min, UINT32_MAX, memory_order_relaxed);
+    atomic_store_explicit(&stats_fill_max, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_fill_last, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_fill_sum, 0, memory_order_relaxed);
+}
+
+int AudioThread_GetStats(audio_thread_stats *stats)
+{
+    if (stats == NULL)
+        return -1;
+
+    uint32_t reads = atomic_load_explicit(&stats_reads, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&stats_fill_sum, memory_order_relaxed);
+
+    stats->reads = reads;
+    stats->underruns = atomic_load_explicit(&stats_underruns,
+                                            memory_order_relaxed);
+    stats->underrun_frames = atomic_load_explicit(&stats_underrun_frames,
+                                                  memory_order_relaxed);
+    stats->fill_min = atomic_load_explicit(&stats_fill_min,
+                                           memory_order_relaxed);
+    stats->fill_max = atomic_load_explicit(&stats_fill_max,
+                                           memory_order_relaxed);
+    stats->fill_last = atomic_load_explicit(&stats_fill_last,
+                                            memory_order_relaxed);
+
+    if (reads == 0)
+    {
+        stats->fill_min = 0;
+        stats->fill_average = 0;
+    }
+    else
+    {
+        stats->fill_average = sum / reads;
+    }
+
+    return 0;
+}
+
+int AudioThread_Start(uint32_t sample_rate, size_t look_ahead,
+                      size_t block_size)
+{
+    if (atomic_load(&audio_running))
+        return -1;
+
+    if ((sample_rate == 0) || (block_size == 0) || (block_size > look_ahead))
+        return -1;
+
+    ring_left = malloc(look_ahead);
+    ring_right = malloc(look_ahead);
+    if ((ring_left == NULL) || (ring_right == NULL))
+    {
+        printf("%s(): Not enough memory\n", __func__);
+        goto error;
+    }
+
+    ring_capacity = look_ahead;
+    ring_block_size = block_size;
+    atomic_store(&ring_write_index, 0);
+    atomic_store(&ring_read_index, 0);
+
+    // Sleep for about half the duration of a block when the buffer is full
+    audio_sleep_ns = (long)(((uint64_t)block_size * 500000000) / sample_rate);
+
+    AudioThread_ResetStats();
+
+    atomic_store(&audio_running, 1);
+
+    if (pthread_create(&audio_thread, NULL, AudioThread_Main, NULL) != 0)
+    {
+        printf("%s(): Can't create thread\n", __func__);
+        atomic_store(&audio_running, 0);
+        goto error;
+    }
+
+    return 0;
+
+error:
+    free(ring_left);
+    free(ring_right);
+    ring_left = NULL;
+    ring_right = NULL;
+    return -1;
+}
+
+void AudioThread_Stop(void)
+{
+    if (!atomic_load(&audio_running))
+        return;
+
+    atomic_store(&audio_running, 0);
+    pthread_join(audio_thread, NULL);
+
+    free(ring_left);
+    free(ring_right);
+    ring_left = NULL;
+    ring_right = NULL;
+}
+
+size_t AudioThread_Available(void)
+{
+    size_t write = atomic_load_explicit(&ring_write_index,
+                                        memory_order_acquire);
+    size_t read = atomic_load_explicit(&ring_read_index, memory_order_relaxed);
+
+    return write - read;
+}
+
+size_t AudioThread_Read(int8_t *left_buffer, int8_t *right_buffer,
+                        size_t buffer_size)
+{
+    size_t write = atomic_load_explicit(&ring_write_index,
+                                        memory_order_acquire);
+    size_t read = atomic_load_explicit(&ring_read_index, memory_order_relaxed);
+
+    size_t fill = write - read;
+
+    // Update statistics
+
+    uint32_t fill_stat = (fill > UINT32_MAX) ? UINT32_MAX : (uint32_t)fill;
+
+    atomic_fetch_add_explicit(&stats_reads, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats_fill_sum, fill_stat, memory_order_relaxed);
+    atomic_store_explicit(&stats_fill_last, fill_stat, memory_order_relaxed);
+
+    if (fill_stat < atomic_load_explicit(&stats_fill_min, memory_order_relaxed))
+        atomic_store_explicit(&stats_fill_min, fill_stat, memory_order_relaxed);
+    if (fill_stat > atomic_load_explicit(&stats_fill_max, memory_order_relaxed))
+        atomic_store_explicit(&stats_fill_max, fill_stat, memory_order_relaxed);
+
+    size_t frames = buffer_size;
+    if (frames > fill)
+    {
+        frames = fill;
+
+        atomic_fetch_add_explicit(&stats_underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats_underrun_frames,
+                                  (uint32_t)(buffer_size - frames),
+                                  memory_order_relaxed);
+    }
+
+    if (frames > 0)
+    {
+        // Copy the frames, which may wrap around the end of the ring buffer
+
+        size_t offset = read % ring_capacity;
+        size_t size = ring_capacity - offset;
+        if (size > frames)
+            size = frames;
+
+        memcpy(left_buffer, &ring_left[offset], size);
+        memcpy(left_buffer + size, &ring_left[0], frames - size);
+
+        if (right_buffer != NULL)
+        {
+            memcpy(right_buffer, &ring_right[offset], size);
+            memcpy(right_buffer + size, &ring_right[0], frames - size);
+        }
+
+        // Give the space back to the producer after the data has been copied
+        atomic_store_explicit(&ring_read_index, read + frames,
+                              memory_order_release);
+    }
+
+    // Fill the rest of the buffers with silence
+
+    memset(left_buffer + frames, 0, buffer_size - frames);
+    if (right_buffer != NULL)
+        memset(right_buffer + frames, 0, buffer_size - frames);
+
+    return frames;
+}
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#ifndef AUDIO_THREAD_H__
+#define AUDIO_THREAD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host-side driver that calls UMOD_Mix() from its own thread. It renders ahead
+// of the audio device into a ring buffer, so that the device callback only has
+// to copy data out of it with AudioThread_Read(). A spike in the time it takes
+// to update a song or to mix channels is absorbed by the look-ahead instead of
+// causing an underrun.
+//
+// The ring buffer has a single producer (the render thread) and a single
+// consumer (the caller of AudioThread_Read()), and it doesn't use any lock.
+//
+// The render thread calls UMOD_Mix() with a lock held. Any other function of
+// the library must be called between AudioThread_Lock() and
+// AudioThread_Unlock() while the thread is running. AudioThread_Read() never
+// takes the lock.
+
+typedef struct {
+    uint32_t    reads;              // Number of calls to AudioThread_Read()
+    uint32_t    underruns;          // Reads that couldn't be filled completely
+    uint32_t    underrun_frames;    // Frames replaced by silence
+    uint32_t    fill_min;           // Minimum frames in the ring before a read
+    uint32_t    fill_max;           // Maximum frames in the ring before a read
+    uint32_t    fill_average;       // Average frames in the ring before a read
+    uint32_t    fill_last;          // Frames in the ring before the last read
+} audio_thread_stats;
+
+// Starts the render thread. 'look_ahead' is the size of the ring buffer in
+// frames, and 'block_size' is the number of frames mixed in each call to
+// UMOD_Mix() (it must not be bigger than 'look_ahead'). The library must have
+// been initialized with the same sample rate. It returns 0 on success.
+int AudioThread_Start(uint32_t sample_rate, size_t look_ahead,
+                      size_t block_size);
+
+// Stops the render thread and frees the ring buffer. Any data left in the ring
+// buffer is discarded.
+void AudioThread_Stop(void);
+
+// Copies the specified number of frames out of the ring buffer. If there isn't
+// enough data, the rest of the buffers is filled with silence and the underrun
+// is counted. In mono mode right_buffer isn't used, and it can be NULL. It
+// returns the number of frames that have been copied from the ring buffer.
+size_t AudioThread_Read(int8_t *left_buffer, int8_t *right_buffer,
+                        size_t buffer_size);
+
+// Returns the number of frames that are ready to be read.
+size_t AudioThread_Available(void);
+
+void AudioThread_Lock(void);
+void AudioThread_Unlock(void);
+
+// Gets the statistics gathered since the thread was started or since the last
+// call to AudioThread_ResetStats(). It returns 0 on success.
+int AudioThread_GetStats(audio_thread_stats *stats);
+
+// Resets the statistics. This must be called from the same thread that calls
+// AudioThread_Read(), or while it isn't being called.
+void AudioThread_ResetStats(void);
+
+#endif // AUDIO_THREAD_H__
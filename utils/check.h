@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz
+
+#ifndef CHECK_H__
+#define CHECK_H__
+
+#include <stdio.h>
+
+// Used by the tests to check a condition. If it's false, it prints the line of
+// the check and jumps to the label "cleanup" of the calling function.
+#define CHECK(cond)                                         \
+    do                                                      \
+    {                                                       \
+        if (!(cond))                                        \
+        {                                                   \
+            printf("Line %d: Check failed\n", __LINE__);    \
+            goto cleanup;                                   \
+        }                                                   \
+    } while (0)
+
+#endif // CHECK_H__
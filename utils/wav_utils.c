@@ -5,6 +5,18 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef UTILS_PTHREADS
+# include <pthread.h>
+#endif
+
+#ifdef _WIN32
+# include <fcntl.h>
+# include <io.h>
+#endif
+
+#include "wav_utils.h"
 
 // Information taken from:
 //
@@ -39,51 +51,366 @@ typedef struct {
 } wav_header_t;
 #pragma pack(pop)
 
-static FILE *wav_file;
-static uint32_t wav_sample_rate;
-
 // Hardcode format to 16-bit (signed), two channels
 
 #define WAV_NUMBER_CHANNELS     (2)
 #define WAV_BITS_PER_SAMPLE     (8)
 
-void WAV_FileEnd(void)
+// Size of each buffer of a writer
+#define WAV_WRITER_BUFFER_SIZE  (256 * 1024)
+
+#ifdef UTILS_PTHREADS
+# define WAV_WRITER_BUFFERS     (2)
+#else
+# define WAV_WRITER_BUFFERS     (1)
+#endif
+
+struct wav_writer {
+    FILE       *file;
+    wav_format  format;
+    uint32_t    sample_rate;
+    size_t      data_size;      // Bytes of data written so far
+    int         error;
+
+    uint8_t    *buffer[WAV_WRITER_BUFFERS];
+    int         active;         // Buffer being filled
+    size_t      used;           // Bytes used in the active buffer
+
+#ifdef UTILS_PTHREADS
+    // The thread writes 'pending_size' bytes of buffer 'pending' to the file.
+    // It is -1 when the thread is idle.
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             pending;
+    size_t          pending_size;
+    int             quit;
+#endif
+};
+
+static void WAV_HeaderFill(wav_header_t *header, uint32_t sample_rate,
+                           size_t data_size)
 {
-    // Check if there is an open file
-    if (wav_file == NULL)
-        return;
-
-    // Now that the final size is known, write the header
-
-    fseek(wav_file, 0, SEEK_END);
-    long int size = ftell(wav_file);
-
-    wav_header_t header = {
+    *header = (wav_header_t){
         .chunk_id = 0x46464952,
-        .chunk_size = size - sizeof(uint32_t) - sizeof(uint32_t),
+        .chunk_size = data_size + sizeof(wav_header_t)
+                    - sizeof(uint32_t) - sizeof(uint32_t),
         .format = 0x45564157,
 
         .subchunk_1_id = 0x20746D66,
         .subchunk_1_size = 16,
         .audio_format = 1,
         .num_channels = WAV_NUMBER_CHANNELS,
-        .sample_rate = wav_sample_rate,
-        .byte_rate = wav_sample_rate * WAV_NUMBER_CHANNELS * WAV_BITS_PER_SAMPLE / 8,
+        .sample_rate = sample_rate,
+        .byte_rate = sample_rate * WAV_NUMBER_CHANNELS * WAV_BITS_PER_SAMPLE / 8,
         .block_align = WAV_NUMBER_CHANNELS * WAV_BITS_PER_SAMPLE / 8,
         .bits_per_sample = WAV_BITS_PER_SAMPLE,
 
         .subchunk_2_id = 0x61746164,
-        .subchunk_2_size = size - sizeof(wav_header_t),
+        .subchunk_2_size = data_size,
     };
+}
+
+static int WAV_WriterWriteFile(wav_writer *writer, const uint8_t *buffer,
+                               size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    if (fwrite(buffer, size, 1, writer->file) != 1)
+        return -1;
+
+    return 0;
+}
+
+#ifdef UTILS_PTHREADS
+
+static void *WAV_WriterThread(void *arg)
+{
+    wav_writer *writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+
+    while (1)
+    {
+        while ((writer->pending == -1) && !writer->quit)
+            pthread_cond_wait(&writer->cond, &writer->lock);
+
+        if (writer->pending == -1)
+            break;
+
+        const uint8_t *buffer = writer->buffer[writer->pending];
+        size_t size = writer->pending_size;
+
+        // The buffer isn't touched by the main thread until it's released, so
+        // it can be written without holding the lock.
+        pthread_mutex_unlock(&writer->lock);
+        int ret = WAV_WriterWriteFile(writer, buffer, size);
+        pthread_mutex_lock(&writer->lock);
+
+        if (ret != 0)
+            writer->error = 1;
+
+        writer->pending = -1;
+        pthread_cond_broadcast(&writer->cond);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+static int WAV_WriterHasError(wav_writer *writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    int error = writer->error;
+    pthread_mutex_unlock(&writer->lock);
+
+    return error;
+}
+
+// Waits until the thread isn't writing any buffer
+static void WAV_WriterWait(wav_writer *writer)
+{
+    pthread_mutex_lock(&writer->lock);
+
+    while (writer->pending != -1)
+        pthread_cond_wait(&writer->cond, &writer->lock);
+
+    pthread_mutex_unlock(&writer->lock);
+}
+
+// Hands the active buffer to the thread and starts filling the other one
+static void WAV_WriterFlush(wav_writer *writer)
+{
+    if (writer->used == 0)
+        return;
+
+    pthread_mutex_lock(&writer->lock);
+
+    while (writer->pending != -1)
+        pthread_cond_wait(&writer->cond, &writer->lock);
+
+    writer->pending = writer->active;
+    writer->pending_size = writer->used;
+    pthread_cond_broadcast(&writer->cond);
+
+    pthread_mutex_unlock(&writer->lock);
+
+    writer->active ^= 1;
+    writer->used = 0;
+}
+
+#else // UTILS_PTHREADS
+
+static int WAV_WriterHasError(wav_writer *writer)
+{
+    return writer->error;
+}
+
+static void WAV_WriterWait(wav_writer *writer)
+{
+    (void)writer;
+}
+
+static void WAV_WriterFlush(wav_writer *writer)
+{
+    if (WAV_WriterWriteFile(writer, writer->buffer[0], writer->used) != 0)
+        writer->error = 1;
+
+    writer->used = 0;
+}
+
+#endif // UTILS_PTHREADS
+
+static void WAV_WriterFree(wav_writer *writer)
+{
+    for (int i = 0; i < WAV_WRITER_BUFFERS; i++)
+        free(writer->buffer[i]);
+
+    free(writer);
+}
+
+wav_writer *WAV_WriterOpen(const char *path, uint32_t sample_rate,
+                           wav_format format)
+{
+    int to_stdout = (strcmp(path, "-") == 0);
+
+    if (to_stdout && (format != WAV_FORMAT_RAW))
+    {
+        fprintf(stderr, "%s(): Only raw data can be written to stdout\n",
+                __func__);
+        return NULL;
+    }
+
+    wav_writer *writer = calloc(1, sizeof(wav_writer));
+    if (writer == NULL)
+        return NULL;
+
+    for (int i = 0; i < WAV_WRITER_BUFFERS; i++)
+    {
+        writer->buffer[i] = malloc(WAV_WRITER_BUFFER_SIZE);
+        if (writer->buffer[i] == NULL)
+        {
+            fprintf(stderr, "%s(): Can't allocate buffers\n", __func__);
+            WAV_WriterFree(writer);
+            return NULL;
+        }
+    }
+
+    if (to_stdout)
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        fflush(stdout);
+        writer->file = stdout;
+    }
+    else
+    {
+        writer->file = fopen(path, "wb");
+        if (writer->file == NULL)
+        {
+            fprintf(stderr, "%s(): Can't open file for writing: %s\n",
+                    __func__, path);
+            WAV_WriterFree(writer);
+            return NULL;
+        }
+    }
+
+    // The writer does its own buffering
+    setvbuf(writer->file, NULL, _IONBF, 0);
+
+    writer->format = format;
+    writer->sample_rate = sample_rate;
+
+    if (format == WAV_FORMAT_WAV)
+    {
+        // Leave space for the header, it is written when the size is known
+        wav_header_t header = { 0 };
+        if (fwrite(&header, sizeof(header), 1, writer->file) != 1)
+        {
+            fprintf(stderr, "%s(): Can't allocate space for header\n",
+                    __func__);
+            fclose(writer->file);
+            WAV_WriterFree(writer);
+            return NULL;
+        }
+    }
+
+#ifdef UTILS_PTHREADS
+    writer->pending = -1;
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    if (pthread_create(&writer->thread, NULL, WAV_WriterThread, writer) != 0)
+    {
+        fprintf(stderr, "%s(): Can't create thread\n", __func__);
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->lock);
+        if (!to_stdout)
+            fclose(writer->file);
+        WAV_WriterFree(writer);
+        return NULL;
+    }
+#endif
+
+    return writer;
+}
+
+int WAV_WriterStream(wav_writer *writer, const void *buffer, size_t size)
+{
+    const uint8_t *src = buffer;
+
+    writer->data_size += size;
+
+    while (size > 0)
+    {
+        size_t copy = WAV_WRITER_BUFFER_SIZE - writer->used;
+        if (copy > size)
+            copy = size;
+
+        memcpy(&writer->buffer[writer->active][writer->used], src, copy);
+        writer->used += copy;
+        src += copy;
+        size -= copy;
+
+        if (writer->used == WAV_WRITER_BUFFER_SIZE)
+            WAV_WriterFlush(writer);
+    }
+
+    return WAV_WriterHasError(writer) ? -1 : 0;
+}
+
+int WAV_WriterClose(wav_writer *writer)
+{
+    if (writer == NULL)
+        return -1;
+
+    WAV_WriterFlush(writer);
+    WAV_WriterWait(writer);
+
+#ifdef UTILS_PTHREADS
+    pthread_mutex_lock(&writer->lock);
+    writer->quit = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->lock);
+#endif
+
+    int rc = writer->error ? -1 : 0;
+
+    if (rc != 0)
+        fprintf(stderr, "%s(): Failed to write data\n", __func__);
+
+    if (writer->format == WAV_FORMAT_WAV)
+    {
+        // Now that the final size is known, write the header
+
+        wav_header_t header;
+        WAV_HeaderFill(&header, writer->sample_rate, writer->data_size);
+
+        if ((fseek(writer->file, 0, SEEK_SET) != 0) ||
+            (fwrite(&header, sizeof(header), 1, writer->file) != 1))
+        {
+            fprintf(stderr, "%s(): Can't write header\n", __func__);
+            rc = -1;
+        }
+    }
+
+    if (writer->file == stdout)
+    {
+        if (fflush(stdout) != 0)
+            rc = -1;
+    }
+    else
+    {
+        if (fclose(writer->file) != 0)
+            rc = -1;
+    }
 
-    fseek(wav_file, 0, SEEK_SET);
+    WAV_WriterFree(writer);
 
-    if (fwrite(&header, sizeof(header), 1, wav_file) != 1)
-        printf("%s(): Can't write header\n", __func__);
+    return rc;
+}
 
-    fclose(wav_file);
+// Single file API
+// ===============
 
-    //printf("%s: File saved. Size: %ld\n", __func__, size);
+static wav_writer *wav_file;
+
+void WAV_FileEnd(void)
+{
+    // Check if there is an open file
+    if (wav_file == NULL)
+        return;
+
+    WAV_WriterClose(wav_file);
 
     wav_file = NULL;
 }
@@ -96,21 +423,9 @@ void WAV_FileStart(const char *path, uint32_t sample_rate)
     if (wav_file)
         WAV_FileEnd();
 
-    wav_file = fopen(path, "wb");
+    wav_file = WAV_WriterOpen(path, sample_rate, WAV_FORMAT_WAV);
     if (wav_file == NULL)
-    {
-        printf("%s(): Can't open file for writing: %s\n", __func__, path);
-        return;
-    }
-
-    wav_header_t header =  { 0 };
-    if (fwrite(&header, sizeof(header), 1, wav_file) != 1)
-    {
-        printf("%s(): Can't allocate space for header\n", __func__);
         return;
-    }
-
-    wav_sample_rate = sample_rate;
 
     // Close file when the program exits
     atexit(WAV_FileEnd);
@@ -129,6 +444,6 @@ void WAV_FileStream(void *buffer, size_t size)
     if (wav_file == NULL)
         return;
 
-    if (fwrite(buffer, size, 1, wav_file) != 1)
-        printf("%s(): Failed to write data\n", __func__);
+    if (WAV_WriterStream(wav_file, buffer, size) != 0)
+        fprintf(stderr, "%s(): Failed to write data\n", __func__);
 }
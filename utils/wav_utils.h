@@ -15,4 +15,36 @@ int WAV_FileIsOpen(void);
 
 void WAV_FileStream(void *buffer, size_t size);
 
+// Writer objects
+// ==============
+//
+// Unlike the functions above, any number of writers can be open at the same
+// time. The data is copied to a big buffer, and it is only written to the file
+// when the buffer is full. If threads are available, each writer has two
+// buffers and a thread that writes one of them to the file while the other one
+// is being filled, so that rendering and writing to disk overlap.
+//
+// The data must be 8-bit stereo, with each sample biased by 128.
+
+typedef enum {
+    WAV_FORMAT_WAV, // WAV file with a header
+    WAV_FORMAT_RAW, // Raw PCM data without any header
+} wav_format;
+
+typedef struct wav_writer wav_writer;
+
+// Opens a writer. If the path is "-", the data is written to stdout, and the
+// format must be WAV_FORMAT_RAW. It returns NULL on error.
+wav_writer *WAV_WriterOpen(const char *path, uint32_t sample_rate,
+                           wav_format format);
+
+// Copies data to the writer. It returns 0 on success. Errors that happen in
+// the background are reported by the next call to this function or by
+// WAV_WriterClose().
+int WAV_WriterStream(wav_writer *writer, const void *buffer, size_t size);
+
+// Writes all pending data, finishes the header and closes the writer. It
+// returns 0 on success.
+int WAV_WriterClose(wav_writer *writer);
+
 #endif // WAV_UTILS_H__